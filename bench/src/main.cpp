@@ -0,0 +1,893 @@
+#include <eztemp.h>
+#include <ezexpr.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/variant.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory_resource>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// --------------------------------------------
+// allocation accounting
+//
+
+// also counted on the worker pool threads of parallel loops and batches
+static std::atomic<std::size_t> allocated_bytes(0);
+static std::atomic<std::size_t> allocations(0);
+
+// not inlined, so that GCC does not pair the inlined free with operator new
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void * operator new(std::size_t size)
+{
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void * ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+BENCH_NOINLINE void operator delete(void * ptr, std::size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+
+BENCH_NOINLINE void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    if(void * ptr = ::_aligned_malloc(size, align))
+        return ptr;
+#else
+    if(void * ptr = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return ptr;
+#endif
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void * ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    ::_aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+BENCH_NOINLINE void operator delete(void * ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+    ::operator delete(ptr, alignment);
+}
+
+// --------------------------------------------
+// harness
+//
+
+/**
+ * @brief What a single run of a benchmark did.
+ **/
+struct work
+{
+    std::size_t ops;        ///< operations performed (renders, loop items, calls...)
+    std::size_t bytes;      ///< bytes consumed or produced, 0 if meaningless
+};
+
+/**
+ * @brief Measured figures of a benchmark.
+ **/
+struct result
+{
+    std::string name;
+    double ns_per_op;
+    double bytes_per_op;
+    double allocs_per_op;
+    double mb_per_s;
+};
+
+struct options
+{
+    double min_time = 0.5;  ///< seconds spent in each benchmark
+    std::string filter;
+};
+
+static std::vector<result> results;
+
+/**
+ * @brief Run @a fn until @a opts.min_time is elapsed and record the mean figures.
+ *
+ * One untimed run warms the caches up first. Allocations are counted on the
+ * timed runs only.
+ **/
+static void run(const options & opts, const std::string & name, const std::function<work()> & fn)
+{
+    if(!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+        return;
+
+    fn();
+
+    std::size_t ops = 0;
+    std::size_t bytes = 0;
+    std::size_t bytes_before = allocated_bytes.load();
+    std::size_t allocations_before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        work w = fn();
+        ops += w.ops;
+        bytes += w.bytes;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while(elapsed < opts.min_time);
+
+    result r;
+    r.name = name;
+    r.ns_per_op = elapsed * 1e9 / ops;
+    r.bytes_per_op = double(allocated_bytes.load() - bytes_before) / ops;
+    r.allocs_per_op = double(allocations.load() - allocations_before) / ops;
+    r.mb_per_s = bytes ? bytes / elapsed / (1024 * 1024) : 0;
+    results.push_back(r);
+
+    std::cerr << "." << std::flush;
+}
+
+// --------------------------------------------
+// inputs
+//
+
+/**
+ * @brief Build a Json document of about @a megabytes MB.
+ **/
+static std::string make_json(std::size_t megabytes)
+{
+    std::string json = "{ \"title\": \"bench\", \"rows\": [";
+    for(int ii = 0; json.size() < megabytes * 1024 * 1024; ++ii)
+    {
+        if(ii)
+            json += ",";
+        json += "\n  { \"id\": " + std::to_string(ii)
+              + ", \"name\": \"row number " + std::to_string(ii) + "\""
+              + ", \"ratio\": " + std::to_string(ii / 7.)
+              + ", \"enabled\": " + (ii % 2 ? "true" : "false")
+              + ", \"tags\": [\"a\", \"b\", null] }";
+    }
+    json += "\n] }";
+    return json;
+}
+
+/**
+ * @brief Build a template of about @a kilobytes KB mixing every kind of token.
+ **/
+static std::string make_template(std::size_t kilobytes)
+{
+    std::string input;
+    for(int ii = 0; input.size() < kilobytes * 1024; ++ii)
+    {
+        input += "<h2>Section " + std::to_string(ii) + "</h2>\n"
+                 "<p>{{ title }} - {{ toupper(title) }}</p>\n"
+                 "{% if enabled %}<ul>\n"
+                 "{% for item in items %}  <li>{{ loop.index }}: {{ item }}</li>\n{% endfor %}"
+                 "</ul>{% else %}<p>disabled</p>{% endif %}\n";
+    }
+    return input;
+}
+
+static ez::temp::array make_items(std::size_t count)
+{
+    ez::temp::array items;
+    items.reserve(count);
+    for(std::size_t ii = 0; ii < count; ++ii)
+    {
+        items.emplace_back("item " + std::to_string(ii));
+    }
+    return items;
+}
+
+/**
+ * @brief Write a chain of @a depth templates, each one extending the previous one.
+ * @return The path of the most derived template.
+ **/
+static std::string make_extends_chain(const fs::path & dir, int depth)
+{
+    {
+        std::ofstream base((dir / "level0.ez").string());
+        base << "<html><head>{% block head %}<title>{{ title }}</title>{% endblock %}</head>\n<body>\n";
+        for(int ii = 1; ii <= depth; ++ii)
+        {
+            base << "{% block level" << ii << " %}default " << ii << "\n{% endblock %}";
+        }
+        base << "</body></html>\n";
+    }
+    for(int ii = 1; ii <= depth; ++ii)
+    {
+        std::ofstream level((dir / ("level" + std::to_string(ii) + ".ez")).string());
+        level << "{% extends level" << ii - 1 << " %}"
+              << "{% block level" << ii << " %}<p>level " << ii << ": {{ title }}</p>\n{% endblock %}";
+    }
+    return (dir / ("level" + std::to_string(depth) + ".ez")).string();
+}
+
+// --------------------------------------------
+// benchmarks
+//
+
+/**
+ * @brief Build a template of about @a megabytes MB of text, with a few tags and braces.
+ **/
+static std::string make_text_template(std::size_t megabytes)
+{
+    std::string input;
+    for(int ii = 0; input.size() < megabytes * 1024 * 1024; ++ii)
+    {
+        input += "int function_" + std::to_string(ii) + "(int value) { return value * " + std::to_string(ii) + "; }\n";
+        if(ii % 64 == 0)
+            input += "// {{ title }} {% if enabled %}enabled{% endif %}\n";
+    }
+    return input;
+}
+
+static void compile_benchmarks(const options & opts, std::size_t megabytes)
+{
+    for(std::size_t kilobytes: {16, 256})
+    {
+        const std::string input = make_template(kilobytes);
+        run(opts, "compile/" + std::to_string(kilobytes) + "KB", [&input]() {
+            ez::temp::compiled_template prog = ez::temp::renderer::compile(input);
+            return work{1, input.size()};
+        });
+    }
+
+    // bound by the delimiter scanning, with each lexer implementation
+    const std::string text = make_text_template(megabytes);
+    const ez::temp::lexer_isa best = ez::temp::renderer::current_lexer_isa();
+    const std::pair<ez::temp::lexer_isa, const char *> isas[] = {
+        {ez::temp::lexer_isa::scalar, "scalar"}, {ez::temp::lexer_isa::sse2, "sse2"}, {ez::temp::lexer_isa::avx2, "avx2"},
+    };
+    for(const auto & isa: isas)
+    {
+        if(!ez::temp::renderer::set_lexer_isa(isa.first))
+            continue;
+        run(opts, "compile/text/" + std::to_string(megabytes) + "MB/" + isa.second, [&text]() {
+            ez::temp::compiled_template prog = ez::temp::renderer::compile(text);
+            return work{1, text.size()};
+        });
+    }
+    ez::temp::renderer::set_lexer_isa(best);
+
+    // text tokens are views into the mapped file
+    fs::path path = fs::temp_directory_path() / fs::unique_path("eztemp-bench-%%%%-%%%%.ez");
+    std::ofstream(path.string(), std::ios::binary) << text;
+    run(opts, "compile_file/text/" + std::to_string(megabytes) + "MB", [&path, &text]() {
+        ez::temp::compiled_template prog = ez::temp::renderer::compile_file(path.string());
+        return work{1, text.size()};
+    });
+    fs::remove(path);
+}
+
+static void loop_benchmarks(const options & opts, std::size_t max_items)
+{
+    const ez::temp::compiled_template flat = ez::temp::renderer::compile(
+        "{% for item in items %}{{ item }},{% endfor %}");
+    const ez::temp::compiled_template nested = ez::temp::renderer::compile(
+        "{% for row in rows %}{% for cell in row %}{{ cell }}{% if loop.last %};{% endif %}{% endfor %}{% endfor %}");
+
+    for(std::size_t count = 1000; count <= max_items; count *= 10)
+    {
+        ez::temp::dict context;
+        context["items"] = make_items(count);
+        run(opts, "for/flat/" + std::to_string(count), [&flat, &context, count]() {
+            std::string output = ez::temp::renderer::render(flat, context);
+            return work{count, output.size()};
+        });
+
+        // chunks on the worker pool (sequential on a single core)
+        ez::temp::render_options parallel;
+        parallel.parallel = true;
+        run(opts, "for/parallel/" + std::to_string(count), [&flat, &context, &parallel, count]() {
+            std::string output;
+            ez::temp::string_sink sink(output);
+            ez::temp::renderer::render(flat, context, sink, parallel);
+            return work{count, output.size()};
+        });
+
+        // 100 columns per row
+        ez::temp::array rows(count / 100, make_items(100));
+        context.clear();
+        context["rows"] = std::move(rows);
+        run(opts, "for/nested/" + std::to_string(count), [&nested, &context, count]() {
+            std::string output = ez::temp::renderer::render(nested, context);
+            return work{count, output.size()};
+        });
+    }
+}
+
+static void extends_benchmarks(const options & opts)
+{
+    fs::path dir = fs::temp_directory_path() / fs::unique_path("eztemp-bench-%%%%-%%%%");
+    fs::create_directories(dir);
+
+    ez::temp::dict context;
+    context["title"] = "extends";
+    for(int depth: {1, 8, 32})
+    {
+        const std::string leaf = make_extends_chain(dir, depth);
+        run(opts, "extends/compile/" + std::to_string(depth), [&leaf]() {
+            ez::temp::compiled_template prog = ez::temp::renderer::compile_file(leaf);
+            return work{1, 0};
+        });
+
+        const ez::temp::compiled_template prog = ez::temp::renderer::compile_file(leaf);
+
+        // the same chain precompiled, checked against the templates
+        const std::string precompiled = leaf + "c";
+        prog.save(precompiled);
+        run(opts, "extends/load/" + std::to_string(depth), [&precompiled]() {
+            ez::temp::compiled_template prog = ez::temp::compiled_template::load(precompiled);
+            return work{1, 0};
+        });
+
+        run(opts, "extends/render/" + std::to_string(depth), [&prog, &context]() {
+            std::string output = ez::temp::renderer::render(prog, context);
+            return work{1, output.size()};
+        });
+
+        // without the optimization pass: block markers and unmerged texts
+        const ez::temp::compiled_template plain = ez::temp::renderer::compile_file(leaf, false);
+        run(opts, "extends/render/" + std::to_string(depth) + "/unoptimized", [&plain, &context]() {
+            std::string output = ez::temp::renderer::render(plain, context);
+            return work{1, output.size()};
+        });
+    }
+
+    fs::remove_all(dir);
+}
+
+static void bundle_benchmarks(const options & opts, int count)
+{
+    fs::path dir = fs::temp_directory_path() / fs::unique_path("eztemp-bench-%%%%-%%%%");
+    fs::create_directories(dir);
+
+    // pages sharing a layout
+    {
+        std::ofstream layout((dir / "layout.ez").string());
+        layout << "<html><head>{% block head %}<title>{{ title }}</title>{% endblock %}</head>\n"
+               << "<body>{% block body %}{% endblock %}\n<footer>{{ toupper(title) }}</footer></body></html>\n";
+    }
+    for(int ii = 0; ii < count; ++ii)
+    {
+        std::ofstream page((dir / ("page" + std::to_string(ii) + ".ez")).string());
+        page << "{% extends layout %}{% block body %}<h1>page " << ii << "</h1>\n"
+             << "{% for item in items %}<p>{{ loop.index }}: {{ item.name }}{% if item.price > 10 %} !{% endif %}</p>\n{% endfor %}{% endblock %}";
+    }
+
+    const std::string directory = dir.string();
+    run(opts, "bundle/compile/" + std::to_string(count), [&directory, count]() {
+        ez::temp::template_bundle bundle = ez::temp::template_bundle::compile_directory(directory);
+        return work{static_cast<std::size_t>(count) + 1, 0};
+    });
+
+    const std::string archive = (dir / "bundle.ezb").string();
+    ez::temp::template_bundle::compile_directory(directory).save(archive);
+    run(opts, "bundle/load/" + std::to_string(count), [&archive, count]() {
+        ez::temp::template_bundle bundle = ez::temp::template_bundle::load(archive);
+        return work{static_cast<std::size_t>(count) + 1, 0};
+    });
+
+    fs::remove_all(dir);
+}
+
+static void json_benchmarks(const options & opts, std::size_t megabytes)
+{
+    const std::string json = make_json(megabytes);
+
+    run(opts, "json/from_json/" + std::to_string(megabytes) + "MB", [&json]() {
+        ez::temp::dict context = ez::temp::dict::from_json(json);
+        return work{1, json.size()};
+    });
+
+    // previous loader, without its conversion from the property tree
+    run(opts, "json/property_tree/" + std::to_string(megabytes) + "MB", [&json]() {
+        std::stringstream ss(json);
+        boost::property_tree::ptree pt;
+        boost::property_tree::read_json(ss, pt);
+        return work{1, json.size()};
+    });
+}
+
+static void function_benchmarks(const options & opts)
+{
+    const std::size_t count = 10000;
+    ez::temp::dict context;
+    context["items"] = make_items(count);
+
+    const ez::temp::compiled_template builtin = ez::temp::renderer::compile(
+        "{% for item in items %}{{ toupper(item) }}{% endfor %}");
+    run(opts, "function/toupper", [&builtin, &context, count]() {
+        std::string output = ez::temp::renderer::render(builtin, context);
+        return work{count, output.size()};
+    });
+
+    const ez::temp::compiled_template user = ez::temp::renderer::compile(
+        "{% for item in items %}{{ bench_length(item, loop.index) }}{% endfor %}");
+    run(opts, "function/user", [&user, &context, count]() {
+        std::string output = ez::temp::renderer::render(user, context);
+        return work{count, output.size()};
+    });
+}
+
+static void expr_benchmarks(const options & opts)
+{
+    ez::temp::dict context;
+    context["a"] = 1;
+    context["b"] = 2.5;
+    context["c"] = 9;
+
+    const std::string input = "a * 2 + b / 3 - sqrt(c) ** 2";
+    run(opts, "expr/eval", [&context, &input]() {
+        volatile double value = ez::expr::eval<double>(input, context);
+        (void)value;
+        return work{1, 0};
+    });
+
+    const ez::expr::compiled_expression<double> expr(input);
+    run(opts, "expr/compiled/context", [&context, &expr]() {
+        volatile double value = expr.evaluate(context);
+        (void)value;
+        return work{1, 0};
+    });
+
+    const std::size_t rows = 1000;
+    std::vector<double> slots(rows * expr.variables().size());
+    for(std::size_t ii = 0; ii < slots.size(); ++ii)
+        slots[ii] = double(ii % 17);
+    run(opts, "expr/compiled/slots", [&slots, &expr, rows]() {
+        volatile double total = 0;
+        for(std::size_t ii = 0; ii < rows; ++ii)
+            total = total + expr.evaluate(&slots[ii * expr.variables().size()]);
+        return work{rows, 0};
+    });
+
+    // expressions in tags, against the plain key path test
+    const std::size_t count = 10000;
+    context["items"] = make_items(count);
+    const ez::temp::compiled_template key = ez::temp::renderer::compile(
+        "{% for item in items %}{% if loop.first %}{{ loop.index }}{% endif %}{% endfor %}");
+    run(opts, "expr/template/key", [&key, &context, count]() {
+        std::string output = ez::temp::renderer::render(key, context);
+        return work{count, output.size()};
+    });
+    const ez::temp::compiled_template tag = ez::temp::renderer::compile(
+        "{% for item in items %}{% if loop.index > 1 and loop.index < 3 %}{{ loop.index * 2 + 1 }}{% endif %}{% endfor %}");
+    run(opts, "expr/template/expression", [&tag, &context, count]() {
+        std::string output = ez::temp::renderer::render(tag, context);
+        return work{count, output.size()};
+    });
+}
+
+/**
+ * @brief The previous node representation, for comparison.
+ **/
+using legacy_node = boost::make_recursive_variant<
+    std::nullptr_t, std::string, int, double, bool,
+    std::vector<boost::recursive_variant_>,
+    std::map<const std::string, boost::recursive_variant_>>::type;
+using legacy_array = std::vector<legacy_node>;
+using legacy_object = std::map<const std::string, legacy_node>;
+
+/**
+ * @brief Build @a count values with @a make, one op per value.
+ **/
+template <typename Array, typename Make>
+static void run_memory(const options & opts, const std::string & name, std::size_t count, Make make)
+{
+    run(opts, name, [count, &make]() {
+        Array values;
+        values.reserve(count);
+        for(std::size_t ii = 0; ii < count; ++ii)
+        {
+            values.push_back(make(ii));
+        }
+        return work{count, 0};
+    });
+}
+
+static void batch_benchmarks(const options & opts, std::size_t count)
+{
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(
+        "Dear {{ name }},\nyour order {{ order }} of {{ total }} EUR has shipped:\n"
+        "{% for item in items %}  - {{ item }}\n{% endfor %}Regards\n");
+    std::vector<std::string> json;
+    for(std::size_t ii = 0; ii < count; ++ii)
+    {
+        json.push_back("{ \"name\": \"customer " + std::to_string(ii) + "\", \"order\": " + std::to_string(ii)
+                       + ", \"total\": " + std::to_string(ii * 1.5) + ", \"items\": [\"book\", \"pen\", \"lamp\"] }");
+    }
+
+    // one render call per context, against the batch on the worker pool
+    run(opts, "batch/loop/" + std::to_string(count), [&tmpl, &json, count]() {
+        std::size_t bytes = 0;
+        for(const std::string & context: json)
+            bytes += ez::temp::renderer::render(tmpl, ez::temp::dict::from_json(context)).size();
+        return work{count, bytes};
+    });
+    run(opts, "batch/render_batch/" + std::to_string(count), [&tmpl, &json, count]() {
+        std::size_t bytes = 0;
+        ez::temp::renderer::render_batch(tmpl, json, [&bytes](std::size_t, std::string_view output) {
+            bytes += output.size();
+        });
+        return work{count, bytes};
+    });
+}
+
+static void cache_benchmarks(const options & opts)
+{
+    // a page with a navigation built from a large loop
+    ez::temp::dict context;
+    context["title"] = "cache";
+    context["links"] = make_items(1000);
+    const std::string navigation = "<nav>{% for link in links %}<a href=\"/{{ link }}\">{{ link }}</a>{% endfor %}</nav>";
+    const ez::temp::compiled_template plain = ez::temp::renderer::compile("<h1>{{ title }}</h1>" + navigation);
+    const ez::temp::compiled_template cached = ez::temp::renderer::compile(
+        "<h1>{{ title }}</h1>{% cache 'bench-navigation' %}" + navigation + "{% endcache %}");
+
+    run(opts, "cache/page/uncached", [&plain, &context]() {
+        std::string output = ez::temp::renderer::render(plain, context);
+        return work{1, output.size()};
+    });
+    ez::temp::renderer::cache().invalidate("bench-navigation");
+    run(opts, "cache/page/cached", [&cached, &context]() {
+        std::string output = ez::temp::renderer::render(cached, context);
+        return work{1, output.size()};
+    });
+}
+
+static void memory_benchmarks(const options & opts, std::size_t count)
+{
+    run_memory<ez::temp::array>(opts, "memory/node/int", count, [](std::size_t ii) {
+        return ez::temp::node(int(ii));
+    });
+    run_memory<legacy_array>(opts, "memory/legacy_node/int", count, [](std::size_t ii) {
+        return legacy_node(int(ii));
+    });
+    // 16 to 22 characters: inline in a node, beyond std::string's own small buffer
+    run_memory<ez::temp::array>(opts, "memory/node/short_string", count, [](std::size_t ii) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "item %06zu value", ii);
+        return ez::temp::node(buffer);
+    });
+    run_memory<legacy_array>(opts, "memory/legacy_node/short_string", count, [](std::size_t ii) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "item %06zu value", ii);
+        return legacy_node(std::string(buffer));
+    });
+    run_memory<ez::temp::array>(opts, "memory/node/object", count, [](std::size_t ii) {
+        return ez::temp::node(ez::temp::object{
+            {"id", int(ii)},
+            {"name", "item " + std::to_string(ii)},
+            {"tags", ez::temp::array{"a", "b"}},
+        });
+    });
+    run_memory<legacy_array>(opts, "memory/legacy_node/object", count, [](std::size_t ii) {
+        legacy_object obj;
+        obj["id"] = int(ii);
+        obj["name"] = "item " + std::to_string(ii);
+        obj["tags"] = legacy_array{std::string("a"), std::string("b")};
+        return legacy_node(obj);
+    });
+}
+
+/**
+ * @brief A request: parse its Json context, render a page into a string, with
+ * the default allocator or on a monotonic arena released in one step.
+ **/
+static void request_benchmarks(const options & opts)
+{
+    std::string json = "{ \"title\" : \"request\", \"products\" : [";
+    for(int ii = 0; ii < 100; ++ii)
+    {
+        json += ii ? ", " : "";
+        json += "{ \"name\" : \"product number " + std::to_string(ii) + " of the catalog\", \"price\" : "
+              + std::to_string(ii * 3) + ", \"tags\" : [\"new\", \"sale\"] }";
+    }
+    json += "] }";
+    const ez::temp::compiled_template page = ez::temp::renderer::compile(
+        "<h1>{{ title }}</h1><ul>{% for product in products %}<li>{{ product.name }}: {{ product.price }}"
+        "{% for tag in product.tags %} #{{ tag }}{% endfor %}</li>{% endfor %}</ul>");
+
+    run(opts, "memory/request/default", [&json, &page]() {
+        ez::temp::dict context = ez::temp::dict::from_json(json);
+        std::string output = ez::temp::renderer::render(page, context);
+        return work{1, output.size()};
+    });
+
+    std::vector<char> buffer(1024 * 1024);
+    run(opts, "memory/request/arena", [&json, &page, &buffer]() {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        std::pmr::string output(&arena);
+        {
+            ez::temp::dict context = ez::temp::dict::from_json(json, &arena);
+            ez::temp::render_options options;
+            options.memory = &arena;
+            ez::temp::pmr_string_sink sink(output);
+            ez::temp::renderer::render(page, context, sink, options);
+        }
+        return work{1, output.size()};
+    });
+}
+
+/**
+ * @brief The values of a large context, which a page only uses a few of:
+ * built up front into a dict, or given on demand by a context_provider.
+ **/
+static ez::temp::node make_record(int index)
+{
+    return ez::temp::object{{"id", index}, {"name", "record number " + std::to_string(index)}, {"score", index * 0.5}};
+}
+
+class record_provider: public ez::temp::context_provider
+{
+public:
+    bool resolve(const std::vector<std::string> & keys, ez::temp::node & value) override
+    {
+        if(keys.size() != 1 || keys[0].compare(0, 6, "record") != 0)
+            return false;
+        value = make_record(std::atoi(keys[0].c_str() + 6));
+        return true;
+    }
+};
+
+static void provider_benchmarks(const options & opts, int count)
+{
+    const ez::temp::compiled_template page = ez::temp::renderer::compile(
+        "<h1>{{ record7.name }}</h1><p>{{ record7.score }} - {{ record42.name }} - {{ record7.id }}</p>");
+
+    run(opts, "provider/dict/" + std::to_string(count), [&page, count]() {
+        ez::temp::dict context;
+        for(int ii = 0; ii < count; ++ii)
+            context["record" + std::to_string(ii)] = make_record(ii);
+        std::string output = ez::temp::renderer::render(page, context);
+        return work{1, output.size()};
+    });
+
+    record_provider provider;
+    run(opts, "provider/lazy/" + std::to_string(count), [&page, &provider]() {
+        ez::temp::dict context;
+        std::string output;
+        ez::temp::string_sink sink(output);
+        ez::temp::render_options options;
+        options.provider = &provider;
+        ez::temp::renderer::render(page, context, sink, options);
+        return work{1, output.size()};
+    });
+}
+
+// --------------------------------------------
+// reporting
+//
+
+/**
+ * @brief Timings are compared with @a tolerance percent of slack, allocation
+ *        counts are deterministic and compared strictly.
+ **/
+static bool is_regression(const result & r, const result & base, double tolerance)
+{
+    return (r.ns_per_op / base.ns_per_op - 1) * 100 > tolerance
+        || r.allocs_per_op > base.allocs_per_op * 1.01 + 0.01;
+}
+
+static void print_table(std::ostream & out, const std::map<std::string, result> & baseline, double tolerance)
+{
+    out << std::left << std::setw(36) << "benchmark" << std::right
+        << std::setw(14) << "ns/op"
+        << std::setw(12) << "B/op"
+        << std::setw(12) << "allocs/op"
+        << std::setw(10) << "MB/s";
+    if(!baseline.empty())
+        out << std::setw(10) << "vs base";
+    out << std::endl;
+
+    out << std::fixed;
+    for(const result & r: results)
+    {
+        out << std::left << std::setw(36) << r.name << std::right
+            << std::setprecision(1) << std::setw(14) << r.ns_per_op
+            << std::setw(12) << r.bytes_per_op
+            << std::setprecision(2) << std::setw(12) << r.allocs_per_op
+            << std::setprecision(1) << std::setw(10) << r.mb_per_s;
+        auto it = baseline.find(r.name);
+        if(it != baseline.end())
+        {
+            double delta = (r.ns_per_op / it->second.ns_per_op - 1) * 100;
+            out << std::showpos << std::setw(9) << delta << "%" << std::noshowpos;
+            if(is_regression(r, it->second, tolerance))
+                out << "  REGRESSION";
+        }
+        out << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+static void print_json(std::ostream & out)
+{
+    out << "{\n  \"results\": [";
+    for(std::size_t ii = 0; ii < results.size(); ++ii)
+    {
+        const result & r = results[ii];
+        out << (ii ? "," : "") << "\n    { \"name\": \"" << r.name << "\""
+            << ", \"ns_per_op\": " << r.ns_per_op
+            << ", \"bytes_per_op\": " << r.bytes_per_op
+            << ", \"allocs_per_op\": " << r.allocs_per_op
+            << ", \"mb_per_s\": " << r.mb_per_s << " }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void print_csv(std::ostream & out)
+{
+    out << "name,ns_per_op,bytes_per_op,allocs_per_op,mb_per_s\n";
+    for(const result & r: results)
+    {
+        out << r.name << "," << r.ns_per_op << "," << r.bytes_per_op << ","
+            << r.allocs_per_op << "," << r.mb_per_s << "\n";
+    }
+}
+
+static double as_number(const ez::temp::node & value)
+{
+    return value.is_int() ? value.as_int() : value.as_double();
+}
+
+/**
+ * @brief Load results previously written with --format json.
+ **/
+static std::map<std::string, result> load_baseline(const std::string & path)
+{
+    std::ifstream fs(path);
+    if(!fs)
+        throw std::runtime_error("cannot open baseline: " + path);
+    ez::temp::dict doc = ez::temp::dict::from_json(
+        std::string(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>()));
+
+    std::map<std::string, result> baseline;
+    for(const ez::temp::node & item: doc.at("results").as_array())
+    {
+        const ez::temp::object & obj = item.as_object();
+        result r;
+        r.name = std::string(obj.at("name").as_string());
+        r.ns_per_op = as_number(obj.at("ns_per_op"));
+        r.bytes_per_op = as_number(obj.at("bytes_per_op"));
+        r.allocs_per_op = as_number(obj.at("allocs_per_op"));
+        r.mb_per_s = as_number(obj.at("mb_per_s"));
+        baseline[r.name] = r;
+    }
+    return baseline;
+}
+
+int main(int argc, char ** argv)
+{
+    try
+    {
+        options opts;
+        std::string format = "text";
+        std::string baseline_path;
+        double tolerance = 20;
+        std::size_t megabytes = 4;
+        std::size_t max_items = 1000000;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help", "produce help message")
+            ("filter", po::value(&opts.filter), "Only run benchmarks whose name contains <filter>")
+            ("min-time", po::value(&opts.min_time), "Seconds spent in each benchmark (default 0.5)")
+            ("quick", "Small inputs and short runs, to check that everything still runs")
+            ("format", po::value(&format), "Output format: text, json or csv")
+            ("output,o", po::value<std::string>(), "Write the results to <filename> instead of stdout")
+            ("baseline,b", po::value(&baseline_path), "Compare against results previously written with --format json")
+            ("tolerance", po::value(&tolerance), "Slowdown in percent reported as a regression (default 20)")
+        ;
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if(vm.count("help"))
+        {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+
+        if(vm.count("quick"))
+        {
+            opts.min_time = 0;
+            megabytes = 1;
+            max_items = 10000;
+        }
+
+        ez::temp::renderer::add_function("bench_length", [](const ez::temp::array & args) {
+            return std::to_string(args.at(0).as_string().size() + args.at(1).as_int());
+        });
+
+        compile_benchmarks(opts, megabytes);
+        loop_benchmarks(opts, max_items);
+        extends_benchmarks(opts);
+        bundle_benchmarks(opts, 64);
+        json_benchmarks(opts, megabytes);
+        function_benchmarks(opts);
+        expr_benchmarks(opts);
+        batch_benchmarks(opts, vm.count("quick") ? 100 : 10000);
+        cache_benchmarks(opts);
+        memory_benchmarks(opts, vm.count("quick") ? 1000 : 100000);
+        request_benchmarks(opts);
+        provider_benchmarks(opts, 1000);
+        std::cerr << std::endl;
+
+        std::map<std::string, result> baseline;
+        if(!baseline_path.empty())
+            baseline = load_baseline(baseline_path);
+
+        std::ofstream fout;
+        std::ostream * out = &std::cout;
+        if(vm.count("output"))
+        {
+            fout.open(vm["output"].as<std::string>());
+            out = &fout;
+        }
+
+        if(format == "json")
+            print_json(*out);
+        else if(format == "csv")
+            print_csv(*out);
+        else
+            print_table(*out, baseline, tolerance);
+
+        // the table already shows the comparison when it goes to stdout
+        if(!baseline.empty() && (format != "text" || out != &std::cout))
+            print_table(std::cout, baseline, tolerance);
+
+        for(const result & r: results)
+        {
+            auto it = baseline.find(r.name);
+            if(it != baseline.end() && is_regression(r, it->second, tolerance))
+                return 1;
+        }
+        return 0;
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "eztemp-bench: " << e.what() << std::endl;
+    }
+
+    return -1;
+}
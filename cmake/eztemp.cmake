@@ -0,0 +1,51 @@
+# eztemp_add_templates(<target> [NAMESPACE <namespace>] TEMPLATES <template.ez>...)
+#
+# Generates C++ render functions from templates with eztemp-cc --emit-cpp and
+# adds them to <target>. A template "index.html.ez" gives "index.html.h"
+# declaring <namespace>::render_index_html(). Templates are regenerated when
+# they or the layouts they extend change (CMake >= 3.20, or Ninja).
+function(eztemp_add_templates target)
+    cmake_parse_arguments(EZTEMP "" "NAMESPACE" "TEMPLATES" ${ARGN})
+
+    if(TARGET eztemp-cc)
+        set(eztemp_cc $<TARGET_FILE:eztemp-cc>)
+        set(eztemp_cc_depends eztemp-cc)
+    else()
+        find_program(eztemp_cc eztemp-cc)
+        if(NOT eztemp_cc)
+            message(FATAL_ERROR "eztemp_add_templates: eztemp-cc not found")
+        endif()
+        set(eztemp_cc_depends ${eztemp_cc})
+    endif()
+
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/eztemp_generated)
+    file(MAKE_DIRECTORY ${output_dir})
+
+    foreach(template ${EZTEMP_TEMPLATES})
+        get_filename_component(template_path ${template} ABSOLUTE)
+        get_filename_component(template_name ${template} NAME)
+        string(REGEX REPLACE "\\.ez$" "" basename ${template_name})
+        string(REGEX REPLACE "[^A-Za-z0-9]" "_" function render_${basename})
+        if(EZTEMP_NAMESPACE)
+            set(function ${EZTEMP_NAMESPACE}::${function})
+        endif()
+
+        set(output ${output_dir}/${basename})
+        set(depfile_args)
+        if(CMAKE_GENERATOR MATCHES "Ninja" OR NOT CMAKE_VERSION VERSION_LESS 3.20)
+            set(depfile_args DEPFILE ${output}.d)
+        endif()
+
+        add_custom_command(
+            OUTPUT ${output}.cpp ${output}.h
+            COMMAND ${eztemp_cc} ${template_path} --emit-cpp ${output} --function ${function} --depfile ${output}.d
+            DEPENDS ${template_path} ${eztemp_cc_depends}
+            ${depfile_args}
+            COMMENT "Generating C++ code from ${template_name}"
+            VERBATIM)
+
+        target_sources(${target} PRIVATE ${output}.cpp ${output}.h)
+    endforeach()
+
+    target_include_directories(${target} PRIVATE ${output_dir})
+endfunction()
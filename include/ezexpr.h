@@ -8,237 +8,662 @@
 
 #include <eztemp.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <boost/math/constants/constants.hpp>
-#include <boost/spirit/include/phoenix.hpp>
-#include <boost/spirit/include/qi.hpp>
 
 namespace ez {
 
 namespace expr {
 
-struct lazy_pow_
-{
-    template <typename X, typename Y>
-    struct result { typedef X type; };
+template <class T>
+T max_by_value ( const T a, const T b ) {
+    return std::max(a, b);
+}
 
-    template <typename X, typename Y>
-    X operator()(X x, Y y) const
+template <class T>
+T min_by_value ( const T a, const T b ) {
+    return std::min(a, b);
+}
+
+/**
+ * @brief Syntax error in an expression.
+ **/
+class parse_error: public std::runtime_error
+{
+public:
+    parse_error(const std::string & what, std::size_t position):
+        std::runtime_error(what),
+        m_position(position)
     {
-        return std::pow(x, y);
     }
+    inline std::size_t position() const { return m_position; }
+private:
+    std::size_t m_position;
 };
 
-struct lazy_ufunc_
+/**
+ * @brief Missing or non numeric variable.
+ **/
+class eval_error: public std::runtime_error
 {
-    template <typename F, typename A1>
-    struct result { typedef A1 type; };
+public:
+    eval_error(const std::string & what):
+        std::runtime_error(what)
+    {
+    }
+};
 
-    template <typename F, typename A1>
-    A1 operator()(F f, A1 a1) const
+/**
+ * @brief The ast struct
+ * A parsed expression, independent of the evaluation type.
+ * Nodes are stored in post-order (children before their parent, the root
+ * last) and refer to their operands by index. Variables are numbered by
+ * order of first appearance: these are the evaluation slots.
+ **/
+struct ast
+{
+    enum class op : std::uint8_t {
+        number,     // value
+        constant,   // index in constant_names(), lhs: the slot of its name if bound (see parser), else -1
+        variable,   // index: the slot
+        negate,     // lhs
+        add, subtract, multiply, divide, power,     // lhs, rhs
+        call1,      // index in unary_names(), lhs
+        call2,      // index in binary_names(), lhs, rhs
+        boolean,    // value (0 or 1)
+        string,     // index in strings
+        equal, not_equal, less, less_equal, greater, greater_equal,    // lhs, rhs
+        logical_and, logical_or,    // lhs, rhs, rhs evaluated only if needed
+        logical_not,                // lhs
+    };
+
+    struct node
+    {
+        op kind;
+        int index;
+        int lhs;
+        int rhs;
+        double value;
+    };
+
+    std::vector<node> nodes;
+    std::vector<std::string> variables;
+    std::vector<std::string> strings;
+
+    static const std::vector<std::string> & constant_names()
     {
-        return f(a1);
+        static const std::vector<std::string> names = {"digits", "digits10", "e", "epsilon", "pi"};
+        return names;
+    }
+    static const std::vector<std::string> & unary_names()
+    {
+        static const std::vector<std::string> names = {
+            "abs", "acos", "asin", "atan", "ceil", "cos", "cosh", "exp",
+            "floor", "log10", "log", "sin", "sinh", "sqrt", "tan", "tanh",
+        };
+        return names;
+    }
+    static const std::vector<std::string> & binary_names()
+    {
+        static const std::vector<std::string> names = {"atan2", "max", "min", "pow"};
+        return names;
     }
 };
 
-struct lazy_bfunc_
+/**
+ * @brief The parser class
+ * Recursive descent parser of arithmetic expressions with comparisons,
+ * boolean operators and literals, building an ast:
+ *  disjunction := conjunction (('or' | '||') conjunction)*
+ *  conjunction := negation (('and' | '&&') negation)*
+ *  negation    := ('not' | '!') negation | comparison
+ *  comparison  := expression (('==' | '!=' | '<' | '<=' | '>' | '>=') expression)?
+ *  expression  := term (('+' | '-') term)*
+ *  term        := factor (('*' | '/') factor)*
+ *  factor      := primary ('**' factor)*
+ *  primary     := real | '(' expression ')' | ('-' | '+') primary
+ *               | unary '(' expression ')' | binary '(' expression ',' expression ')'
+ *               | constant | 'true' | 'false' | string | variable
+ * Strings are quoted with ' or ", with \\ escaping the next character.
+ * Function and constant names are case insensitive and take precedence
+ * over variables. Variables may be dotted key paths.
+ * With @a bind_constants, a constant also gets the slot of a variable named
+ * as written, for an evaluator to give a bound variable precedence.
+ **/
+class parser
 {
-    template <typename F, typename A1, typename A2>
-    struct result { typedef A1 type; };
+public:
+    parser(const std::string & input, bool bind_constants = false):
+        m_input(input), m_pos(0), m_bind_constants(bind_constants) {}
 
-    template <typename F, typename A1, typename A2>
-    A1 operator()(F f, A1 a1, A2 a2) const
+    ast parse()
     {
-        return f(a1, a2);
+        disjunction();
+        skip();
+        if(m_pos != m_input.size())
+            throw error("unexpected character");
+        return std::move(m_ast);
     }
-};
 
-template <class T>
-T max_by_value ( const T a, const T b ) {
-    return std::max(a, b);
-}
+private:
+    parse_error error(const std::string & what) const
+    {
+        std::stringstream ss;
+        ss << "ez::expr::parse: " << what << " at " << m_pos << " in \"" << m_input << "\"";
+        return parse_error(ss.str(), m_pos);
+    }
 
-template <class T>
-T min_by_value ( const T a, const T b ) {
-    return std::min(a, b);
-}
+    void skip()
+    {
+        while(m_pos < m_input.size() && std::isspace(static_cast<unsigned char>(m_input[m_pos])))
+            ++m_pos;
+    }
 
-template <typename FPT, typename Iterator>
-struct grammar
-    : boost::spirit::qi::grammar<
-            Iterator, FPT(), boost::spirit::ascii::space_type
-        >
-{
+    bool accept(const char * token)
+    {
+        skip();
+        std::size_t size = std::strlen(token);
+        if(m_input.compare(m_pos, size, token) == 0)
+        {
+            m_pos += size;
+            return true;
+        }
+        return false;
+    }
 
-    // symbol table for constants like "pi"
-    struct constant_
-        : boost::spirit::qi::symbols<
-                typename std::iterator_traits<Iterator>::value_type,
-                FPT
-            >
-    {
-        constant_()
-        {
-            this->add
-                ("digits",   std::numeric_limits<FPT>::digits    )
-                ("digits10", std::numeric_limits<FPT>::digits10  )
-                ("e" ,       boost::math::constants::e<FPT>()    )
-                ("epsilon",  std::numeric_limits<FPT>::epsilon() )
-                ("pi",       boost::math::constants::pi<FPT>()   )
-            ;
-        }
-    } constant;
-
-    struct locals_
-        : boost::spirit::qi::symbols<
-                typename std::iterator_traits<Iterator>::value_type,
-                FPT
-            >
-    {
-
-    } locals;
-
-    // symbol table for unary functions like "abs"
-    struct ufunc_
-        : boost::spirit::qi::symbols<
-                typename std::iterator_traits<Iterator>::value_type,
-                FPT (*)(FPT)
-            >
-    {
-        ufunc_()
-        {
-            this->add
-                ("abs"  , static_cast<FPT (*)(FPT)>(&std::abs  ))
-                ("acos" , static_cast<FPT (*)(FPT)>(&std::acos ))
-                ("asin" , static_cast<FPT (*)(FPT)>(&std::asin ))
-                ("atan" , static_cast<FPT (*)(FPT)>(&std::atan ))
-                ("ceil" , static_cast<FPT (*)(FPT)>(&std::ceil ))
-                ("cos"  , static_cast<FPT (*)(FPT)>(&std::cos  ))
-                ("cosh" , static_cast<FPT (*)(FPT)>(&std::cosh ))
-                ("exp"  , static_cast<FPT (*)(FPT)>(&std::exp  ))
-                ("floor", static_cast<FPT (*)(FPT)>(&std::floor))
-                ("log10", static_cast<FPT (*)(FPT)>(&std::log10))
-                ("log"  , static_cast<FPT (*)(FPT)>(&std::log  ))
-                ("sin"  , static_cast<FPT (*)(FPT)>(&std::sin  ))
-                ("sinh" , static_cast<FPT (*)(FPT)>(&std::sinh ))
-                ("sqrt" , static_cast<FPT (*)(FPT)>(&std::sqrt ))
-                ("tan"  , static_cast<FPT (*)(FPT)>(&std::tan  ))
-                ("tanh" , static_cast<FPT (*)(FPT)>(&std::tanh ))
-            ;
-        }
-    } ufunc;
-
-    // symbol table for binary functions like "pow"
-    struct bfunc_
-        : boost::spirit::qi::symbols<
-                typename std::iterator_traits<Iterator>::value_type,
-                FPT (*)(FPT, FPT)
-            >
-    {
-        bfunc_()
-        {
-            this->add
-                ("atan2", static_cast<FPT (*)(FPT, FPT)>(&std::atan2  ))
-                ("max"  , static_cast<FPT (*)(FPT, FPT)>(&max_by_value))
-                ("min"  , static_cast<FPT (*)(FPT, FPT)>(&min_by_value))
-                ("pow"  , static_cast<FPT (*)(FPT, FPT)>(&std::pow    ))
-            ;
-        }
-    } bfunc;
-
-    boost::spirit::qi::rule<
-            Iterator, FPT(), boost::spirit::ascii::space_type
-        > expression, term, factor, primary;
-
-    grammar() : grammar::base_type(expression)
-    {
-        using boost::spirit::qi::real_parser;
-        using boost::spirit::qi::real_policies;
-        real_parser<FPT,real_policies<FPT> > real;
-
-        using boost::spirit::qi::_1;
-        using boost::spirit::qi::_2;
-        using boost::spirit::qi::_3;
-        using boost::spirit::qi::no_case;
-        using boost::spirit::qi::_val;
-
-        boost::phoenix::function<lazy_pow_>   lazy_pow;
-        boost::phoenix::function<lazy_ufunc_> lazy_ufunc;
-        boost::phoenix::function<lazy_bfunc_> lazy_bfunc;
-
-        expression =
-            term                   [_val =  _1]
-            >> *(  ('+' >> term    [_val += _1])
-                |  ('-' >> term    [_val -= _1])
-                )
-            ;
-
-        term =
-            factor                 [_val =  _1]
-            >> *(  ('*' >> factor  [_val *= _1])
-                |  ('/' >> factor  [_val /= _1])
-                )
-            ;
-
-        factor =
-            primary                [_val =  _1]
-            >> *(  ("**" >> factor [_val = lazy_pow(_val, _1)])
-                )
-            ;
-
-        primary =
-            real                   [_val =  _1]
-            |   '(' >> expression  [_val =  _1] >> ')'
-            |   ('-' >> primary    [_val = -_1])
-            |   ('+' >> primary    [_val =  _1])
-            |   (no_case[ufunc] >> '(' >> expression >> ')')
-                                   [_val = lazy_ufunc(_1, _2)]
-            |   (no_case[bfunc] >> '(' >> expression >> ','
-                                       >> expression >> ')')
-                                   [_val = lazy_bfunc(_1, _2, _3)]
-            |   no_case[constant]  [_val =  _1]
-            |   no_case[locals]    [_val =  _1]
-            ;
+    void expect(const char * token)
+    {
+        if(!accept(token))
+            throw error(std::string("expected '") + token + "'");
+    }
+
+    int push(ast::op kind, int lhs = -1, int rhs = -1, int index = -1, double value = 0)
+    {
+        m_ast.nodes.push_back(ast::node{kind, index, lhs, rhs, value});
+        return static_cast<int>(m_ast.nodes.size()) - 1;
+    }
+
+    bool accept_keyword(const char * keyword)
+    {
+        skip();
+        std::size_t size = std::strlen(keyword);
+        std::size_t end = m_pos + size;
+        if(m_input.compare(m_pos, size, keyword) == 0
+           && (end >= m_input.size() || !(std::isalnum(static_cast<unsigned char>(m_input[end])) || m_input[end] == '_' || m_input[end] == '.')))
+        {
+            m_pos = end;
+            return true;
+        }
+        return false;
+    }
+
+    int disjunction()
+    {
+        int lhs = conjunction();
+        while(accept_keyword("or") || accept("||"))
+            lhs = push(ast::op::logical_or, lhs, conjunction());
+        return lhs;
+    }
+
+    int conjunction()
+    {
+        int lhs = negation();
+        while(accept_keyword("and") || accept("&&"))
+            lhs = push(ast::op::logical_and, lhs, negation());
+        return lhs;
+    }
+
+    int negation()
+    {
+        skip();
+        if(accept_keyword("not") || (m_input.compare(m_pos, 2, "!=") != 0 && accept("!")))
+            return push(ast::op::logical_not, negation());
+        return comparison();
+    }
 
+    int comparison()
+    {
+        static const std::pair<const char *, ast::op> operators[] = {
+            {"==", ast::op::equal}, {"!=", ast::op::not_equal},
+            {"<=", ast::op::less_equal}, {">=", ast::op::greater_equal},
+            {"<", ast::op::less}, {">", ast::op::greater},
+        };
+        int lhs = expression();
+        for(const auto & op: operators)
+        {
+            if(accept(op.first))
+                return push(op.second, lhs, expression());
+        }
+        return lhs;
     }
+
+    int expression()
+    {
+        int lhs = term();
+        for(;;)
+        {
+            if(accept("+"))
+                lhs = push(ast::op::add, lhs, term());
+            else if(accept("-"))
+                lhs = push(ast::op::subtract, lhs, term());
+            else
+                return lhs;
+        }
+    }
+
+    int term()
+    {
+        int lhs = factor();
+        for(;;)
+        {
+            skip();
+            if(m_input.compare(m_pos, 2, "**") != 0 && accept("*"))
+                lhs = push(ast::op::multiply, lhs, factor());
+            else if(accept("/"))
+                lhs = push(ast::op::divide, lhs, factor());
+            else
+                return lhs;
+        }
+    }
+
+    int factor()
+    {
+        int lhs = primary();
+        while(accept("**"))
+            lhs = push(ast::op::power, lhs, factor());
+        return lhs;
+    }
+
+    static int find(const std::vector<std::string> & names, const std::string & name)
+    {
+        for(std::size_t ii = 0; ii < names.size(); ++ii)
+        {
+            if(boost::algorithm::iequals(names[ii], name))
+                return static_cast<int>(ii);
+        }
+        return -1;
+    }
+
+    int primary()
+    {
+        skip();
+        if(m_pos >= m_input.size())
+            throw error("unexpected end");
+
+        char c = m_input[m_pos];
+        if(std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+            return number();
+        if(accept("("))
+        {
+            int inner = disjunction();
+            expect(")");
+            return inner;
+        }
+        if(c == '\'' || c == '"')
+            return string();
+        if(accept("-"))
+            return push(ast::op::negate, primary());
+        if(accept("+"))
+            return primary();
+        if(std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+            return identifier();
+        throw error("unexpected character");
+    }
+
+    int number()
+    {
+        std::size_t start = m_pos;
+        std::size_t digits = 0;
+        for(; m_pos < m_input.size() && std::isdigit(static_cast<unsigned char>(m_input[m_pos])); ++m_pos)
+            ++digits;
+        if(m_pos < m_input.size() && m_input[m_pos] == '.')
+        {
+            for(++m_pos; m_pos < m_input.size() && std::isdigit(static_cast<unsigned char>(m_input[m_pos])); ++m_pos)
+                ++digits;
+        }
+        if(!digits)
+            throw error("invalid number");
+        if(m_pos < m_input.size() && (m_input[m_pos] == 'e' || m_input[m_pos] == 'E'))
+        {
+            std::size_t exponent = m_pos + 1;
+            if(exponent < m_input.size() && (m_input[exponent] == '+' || m_input[exponent] == '-'))
+                ++exponent;
+            if(exponent < m_input.size() && std::isdigit(static_cast<unsigned char>(m_input[exponent])))
+            {
+                for(m_pos = exponent; m_pos < m_input.size() && std::isdigit(static_cast<unsigned char>(m_input[m_pos])); ++m_pos);
+            }
+        }
+        return push(ast::op::number, -1, -1, -1, std::strtod(m_input.substr(start, m_pos - start).c_str(), nullptr));
+    }
+
+    int string()
+    {
+        char quote = m_input[m_pos++];
+        std::string value;
+        for(; m_pos < m_input.size() && m_input[m_pos] != quote; ++m_pos)
+        {
+            if(m_input[m_pos] == '\\' && m_pos + 1 < m_input.size())
+                ++m_pos;
+            value += m_input[m_pos];
+        }
+        if(m_pos >= m_input.size())
+            throw error("unterminated string");
+        ++m_pos;
+        m_ast.strings.push_back(std::move(value));
+        return push(ast::op::string, -1, -1, static_cast<int>(m_ast.strings.size()) - 1);
+    }
+
+    int identifier()
+    {
+        std::size_t start = m_pos;
+        while(m_pos < m_input.size() && (std::isalnum(static_cast<unsigned char>(m_input[m_pos]))
+                                         || m_input[m_pos] == '_' || m_input[m_pos] == '.'))
+            ++m_pos;
+        std::string name = m_input.substr(start, m_pos - start);
+
+        skip();
+        bool call = m_pos < m_input.size() && m_input[m_pos] == '(';
+        int index;
+        if(call && (index = find(ast::unary_names(), name)) != -1)
+        {
+            expect("(");
+            int arg = expression();
+            expect(")");
+            return push(ast::op::call1, arg, -1, index);
+        }
+        if(call && (index = find(ast::binary_names(), name)) != -1)
+        {
+            expect("(");
+            int lhs = expression();
+            expect(",");
+            int rhs = expression();
+            expect(")");
+            return push(ast::op::call2, lhs, rhs, index);
+        }
+        if(call)
+        {
+            m_pos = start;
+            throw error("unknown function \"" + name + "\"");
+        }
+        if((index = find(ast::constant_names(), name)) != -1)
+            return push(ast::op::constant, m_bind_constants ? slot(name) : -1, -1, index);
+        if(name == "true" || name == "false")
+            return push(ast::op::boolean, -1, -1, -1, name == "true" ? 1 : 0);
+
+        return push(ast::op::variable, -1, -1, slot(name));
+    }
+
+    int slot(const std::string & name)
+    {
+        auto it = std::find(m_ast.variables.begin(), m_ast.variables.end(), name);
+        if(it == m_ast.variables.end())
+            it = m_ast.variables.insert(it, name);
+        return static_cast<int>(it - m_ast.variables.begin());
+    }
+
+    const std::string & m_input;
+    std::size_t m_pos;
+    bool m_bind_constants;
+    ast m_ast;
 };
 
-template <typename FPT, typename Iterator>
-bool parse(Iterator &iter,
-           Iterator end,
-           const grammar<FPT,Iterator> &g,
-           FPT &result)
+/**
+ * @brief Value of the constant @a index of ast::constant_names().
+ **/
+template <typename T>
+T constant(int index)
 {
-    return boost::spirit::qi::phrase_parse(
-                iter, end, g, boost::spirit::ascii::space, result);
+    switch(index)
+    {
+    case 0: return std::numeric_limits<T>::digits;
+    case 1: return std::numeric_limits<T>::digits10;
+    case 2: return boost::math::constants::e<T>();
+    case 3: return std::numeric_limits<T>::epsilon();
+    default: return boost::math::constants::pi<T>();
+    }
 }
 
+/**
+ * @brief Function @a index of ast::unary_names().
+ **/
 template <typename T>
-T eval(const std::string & input, const ez::temp::dict & context)
+T (*unary(int index))(T)
 {
-    T result;
-    grammar<T,std::string::const_iterator> eg;
-    std::for_each(context.begin(), context.end(), [&eg](const std::pair<std::string, ez::temp::node> & item){
-        try
+    static T (* const functions[])(T) = {
+        &std::abs, &std::acos, &std::asin, &std::atan, &std::ceil, &std::cos, &std::cosh, &std::exp,
+        &std::floor, &std::log10, &std::log, &std::sin, &std::sinh, &std::sqrt, &std::tan, &std::tanh,
+    };
+    return functions[index];
+}
+
+/**
+ * @brief Function @a index of ast::binary_names().
+ **/
+template <typename T>
+T (*binary(int index))(T, T)
+{
+    static T (* const functions[])(T, T) = {
+        &std::atan2, &max_by_value<T>, &min_by_value<T>, &std::pow,
+    };
+    return functions[index];
+}
+
+/**
+ * @brief Find the node at a dotted key path of @a context.
+ * @return nullptr if there is none.
+ **/
+inline const ez::temp::node * find_variable(const ez::temp::object & context, const std::string & path)
+{
+    const ez::temp::object * object = &context;
+    const ez::temp::node * value = nullptr;
+    std::size_t start = 0;
+    for(;;)
+    {
+        std::size_t end = path.find('.', start);
+        auto it = object->find(path.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if(it == object->end())
+            return nullptr;
+        value = &it->second;
+        if(end == std::string::npos)
+            return value;
+        if(!value->is_object())
+            return nullptr;
+        object = &value->as_object();
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief The compiled_expression class
+ * An expression parsed once, then evaluated any number of times with no
+ * reparsing.
+ * Variables are bound to slots, numbered as in variables():
+ * @code
+ * ez::expr::compiled_expression<double> expr("price * (1 + rate)");
+ * double slots[2];
+ * for(const row & r: rows) {
+ *     slots[expr.slot("price")] = r.price;
+ *     slots[expr.slot("rate")] = r.rate;
+ *     total += expr.evaluate(slots);
+ * }
+ * @endcode
+ **/
+template <typename T>
+class compiled_expression
+{
+public:
+    /**
+     * @throw parse_error if @a input is not a valid expression.
+     **/
+    explicit compiled_expression(const std::string & input):
+        m_ast(parser(input).parse())
+    {
+        if(!m_ast.strings.empty())
+            throw parse_error("ez::expr::parse: strings are not numbers in \"" + input + "\"", 0);
+    }
+
+    /**
+     * @brief The variable names, by slot.
+     **/
+    inline const std::vector<std::string> & variables() const { return m_ast.variables; }
+
+    /**
+     * @brief The slot of a variable, -1 if the expression does not use it.
+     **/
+    int slot(const std::string & name) const
+    {
+        auto it = std::find(m_ast.variables.begin(), m_ast.variables.end(), name);
+        return it == m_ast.variables.end() ? -1 : static_cast<int>(it - m_ast.variables.begin());
+    }
+
+    inline const ast & tree() const { return m_ast; }
+
+    /**
+     * @brief Evaluate with the variable values given by slot.
+     * @param slots At least variables().size() values.
+     **/
+    T evaluate(const T * slots) const
+    {
+        return evaluate(static_cast<int>(m_ast.nodes.size()) - 1, slots);
+    }
+
+    T evaluate(const std::vector<T> & slots) const
+    {
+        if(slots.size() < m_ast.variables.size())
+            throw eval_error("ez::expr::evaluate: missing variable values");
+        return evaluate(slots.data());
+    }
+
+    /**
+     * @brief Fill @a slots with the variables found in @a context.
+     * Integers, reals and booleans are accepted.
+     * @throw eval_error if a variable is missing or not a number.
+     **/
+    void bind(const ez::temp::object & context, T * slots) const
+    {
+        for(std::size_t ii = 0; ii < m_ast.variables.size(); ++ii)
+        {
+            const ez::temp::node * value = find_variable(context, m_ast.variables[ii]);
+            if(!value)
+                throw eval_error("ez::expr::evaluate: unknown variable \"" + m_ast.variables[ii] + "\"");
+            switch(value->kind())
+            {
+            case ez::temp::node::type::integer:
+                slots[ii] = static_cast<T>(value->as_int());
+                break;
+            case ez::temp::node::type::real:
+                slots[ii] = static_cast<T>(value->as_double());
+                break;
+            case ez::temp::node::type::boolean:
+                slots[ii] = value->as_bool() ? T(1) : T(0);
+                break;
+            default:
+                throw eval_error("ez::expr::evaluate: \"" + m_ast.variables[ii] + "\" is not a number ("
+                                 + value->type_name() + ")");
+            }
+        }
+    }
+
+    /**
+     * @brief Evaluate with the variables found in @a context.
+     * @throw eval_error if a variable is missing or not a number.
+     **/
+    T evaluate(const ez::temp::object & context) const
+    {
+        constexpr std::size_t inline_slots = 16;
+        if(m_ast.variables.size() <= inline_slots)
         {
-            eg.locals.add(item.first, boost::get<T>(item.second));
+            T slots[inline_slots];
+            bind(context, slots);
+            return evaluate(slots);
         }
-        catch(std::exception & e)
+        std::vector<T> slots(m_ast.variables.size());
+        bind(context, slots.data());
+        return evaluate(slots.data());
+    }
+
+private:
+    T evaluate(int index, const T * slots) const
+    {
+        const ast::node & n = m_ast.nodes[index];
+        switch(n.kind)
         {
-            std::cerr << "ez::expr::eval: warning: unhandled data type (" << item.second.type().name() << ")" << std::endl;
+        case ast::op::number:   return static_cast<T>(n.value);
+        case ast::op::constant: return constant<T>(n.index);
+        case ast::op::variable: return slots[n.index];
+        case ast::op::negate:   return -evaluate(n.lhs, slots);
+        case ast::op::add:      return evaluate(n.lhs, slots) + evaluate(n.rhs, slots);
+        case ast::op::subtract: return evaluate(n.lhs, slots) - evaluate(n.rhs, slots);
+        case ast::op::multiply: return evaluate(n.lhs, slots) * evaluate(n.rhs, slots);
+        case ast::op::divide:   return evaluate(n.lhs, slots) / evaluate(n.rhs, slots);
+        case ast::op::power:    return std::pow(evaluate(n.lhs, slots), evaluate(n.rhs, slots));
+        case ast::op::call1:    return unary<T>(n.index)(evaluate(n.lhs, slots));
+        case ast::op::call2:    return binary<T>(n.index)(evaluate(n.lhs, slots), evaluate(n.rhs, slots));
+        case ast::op::boolean:  return static_cast<T>(n.value);
+        case ast::op::string:   break;
+        case ast::op::equal:         return truth(evaluate(n.lhs, slots) == evaluate(n.rhs, slots));
+        case ast::op::not_equal:     return truth(evaluate(n.lhs, slots) != evaluate(n.rhs, slots));
+        case ast::op::less:          return truth(evaluate(n.lhs, slots) < evaluate(n.rhs, slots));
+        case ast::op::less_equal:    return truth(evaluate(n.lhs, slots) <= evaluate(n.rhs, slots));
+        case ast::op::greater:       return truth(evaluate(n.lhs, slots) > evaluate(n.rhs, slots));
+        case ast::op::greater_equal: return truth(evaluate(n.lhs, slots) >= evaluate(n.rhs, slots));
+        case ast::op::logical_and:   return truth(evaluate(n.lhs, slots) != T(0) && evaluate(n.rhs, slots) != T(0));
+        case ast::op::logical_or:    return truth(evaluate(n.lhs, slots) != T(0) || evaluate(n.rhs, slots) != T(0));
+        case ast::op::logical_not:   return truth(evaluate(n.lhs, slots) == T(0));
         }
-    });
-    std::string::const_iterator ii = input.begin();
-    std::string::const_iterator end = input.end();
-    parse(ii, end, eg, result);
-    return result;
+        return T();
+    }
+
+    static T truth(bool value)
+    {
+        return value ? T(1) : T(0);
+    }
+
+    ast m_ast;
+};
+
+/**
+ * @brief Parse and evaluate an expression once.
+ * Prefer compiled_expression to evaluate an expression several times.
+ * @throw parse_error, eval_error
+ **/
+template <typename T>
+T eval(const std::string & input, const ez::temp::dict & context)
+{
+    return compiled_expression<T>(input).evaluate(context);
 }
 
 } // namespace expr
 
+namespace temp {
+
+/**
+ * @brief The parsed expression with its variables split into key paths.
+ * A plain [not] key.path is not parsed: it only has @a path.
+ **/
+struct expression::program
+{
+    std::string source;
+    ez::expr::ast tree;
+    std::vector<std::vector<std::string>> keys;
+    std::vector<std::string> path;
+    bool negate = false;
+};
+
+} // namespace temp
+
 } // namespace ez
 
 #endif // __EZ_EXPR_H__
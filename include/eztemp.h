@@ -4,16 +4,28 @@
 #ifndef __EZTEMP_H__
 #define __EZTEMP_H__
 
-#include <boost/variant.hpp>
 #include <boost/regex.hpp>
 
 #include <string>
+#include <string_view>
+#include <variant>
+#include <stdexcept>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <chrono>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <cctype>
 #include <functional>
 #include <fstream>
+#include <ostream>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
 
 #include <eztemp_export.h>
 
@@ -21,25 +33,241 @@ namespace ez {
 
 namespace temp {
 
+class node;
+class template_serializer;
+
 /**
- * @brief EZ Node
- * A variant type holding manipulated values.
- */
-using node = boost::make_recursive_variant<
-    std::nullptr_t, std::string, int, double, bool,
-    std::vector<boost::recursive_variant_>,
-    std::map<const std::string, boost::recursive_variant_>>::type;
+ * @brief The memory_scope class
+ * Sets the memory resource the context types (node, array, object, dict)
+ * allocate from on the calling thread, until it goes out of scope. Scopes nest.
+ * Each allocation from a resource records it, so that values can be moved,
+ * copied and freed anywhere, from any thread, but the resource must outlive
+ * them. Without a scope, the global operator new is used, with no record.
+ * A request can run on a std::pmr::monotonic_buffer_resource released in one
+ * step once its context and output are gone (see render_options::memory).
+ * Object keys are std::string, only the longer ones are allocated apart.
+ **/
+class EZTEMP_EXPORT memory_scope
+{
+public:
+    /**
+     * @param resource  The resource to allocate from, null for the global operator new.
+     **/
+    explicit memory_scope(std::pmr::memory_resource * resource);
+    ~memory_scope();
+
+    memory_scope(const memory_scope &) = delete;
+    memory_scope & operator=(const memory_scope &) = delete;
+
+    /**
+     * @brief The resource of the calling thread, null for the global operator new.
+     **/
+    static std::pmr::memory_resource * current();
+
+    /**
+     * @brief Allocate @a bytes from the resource of the calling thread, aligned for any context type.
+     **/
+    static void * allocate(std::size_t bytes);
+
+    /**
+     * @brief Free what allocate() returned, to the resource it came from.
+     **/
+    static void deallocate(void * data, std::size_t bytes) noexcept;
+
+    /**
+     * @brief Alignment of the allocations.
+     **/
+    static constexpr std::size_t alignment = alignof(double) > sizeof(void *) ? alignof(double) : sizeof(void *);
+
+private:
+    std::pmr::memory_resource * m_previous;
+};
+
+/**
+ * @brief The allocator class
+ * Allocator of the context types, allocating through memory_scope.
+ * Stateless: all the allocators are equal.
+ **/
+template <typename T>
+class allocator
+{
+public:
+    using value_type = T;
+
+    allocator() noexcept {}
+    template <typename U>
+    allocator(const allocator<U> &) noexcept {}
+
+    inline T * allocate(std::size_t count)
+    {
+        static_assert(alignof(T) <= memory_scope::alignment, "over-aligned type");
+        return static_cast<T *>(memory_scope::allocate(count * sizeof(T)));
+    }
+    inline void deallocate(T * data, std::size_t count) noexcept { memory_scope::deallocate(data, count * sizeof(T)); }
+
+    template <typename U>
+    inline bool operator==(const allocator<U> &) const noexcept { return true; }
+    template <typename U>
+    inline bool operator!=(const allocator<U> &) const noexcept { return false; }
+};
 
 /**
  * @brief EZ Array
  * A list (vector) of nodes.
  */
-using array = std::vector<ez::temp::node>;
+using array = std::vector<ez::temp::node, ez::temp::allocator<ez::temp::node>>;
+
+/**
+ * @brief EZ Object
+ * Nodes by name, as nested in a node.
+ */
+using object = std::map<const std::string, ez::temp::node, std::less<const std::string>,
+                        ez::temp::allocator<std::pair<const std::string, ez::temp::node>>>;
+
+/**
+ * @brief The bad_node_access class
+ * Thrown when a node is accessed as a type it does not hold.
+ **/
+class bad_node_access: public std::runtime_error
+{
+public:
+    bad_node_access(const char * what):
+        std::runtime_error(what)
+    {
+    }
+};
+
+/**
+ * @brief EZ Node
+ * A compact tagged value (32 bytes): strings of up to 23 characters are
+ * stored inline, arrays in place as a contiguous block of nodes and objects
+ * behind a single pointer.
+ */
+class node
+{
+public:
+    enum class type : std::uint8_t {
+        null, string, integer, real, boolean, array, object,
+    };
+
+    node() noexcept: m_type(type::null) {}
+    node(std::nullptr_t) noexcept: m_type(type::null) {}
+    node(int value) noexcept: m_int(value), m_type(type::integer) {}
+    node(double value) noexcept: m_double(value), m_type(type::real) {}
+    node(bool value) noexcept: m_bool(value), m_type(type::boolean) {}
+    node(const char * value): node(std::string_view(value)) {}
+    node(const std::string & value): node(std::string_view(value)) {}
+    node(std::string_view value);
+    node(const ez::temp::array & value): m_array(value), m_type(type::array) {}
+    node(ez::temp::array && value) noexcept: m_array(std::move(value)), m_type(type::array) {}
+    node(const ez::temp::object & value);
+    node(ez::temp::object && value);
+    node(const node & other);
+    node(node && other) noexcept;
+    ~node() { destroy(); }
+
+    node & operator=(const node & other);
+    node & operator=(node && other) noexcept;
+
+    inline node::type kind() const { return m_type; }
+    inline bool is_null() const { return m_type == type::null; }
+    inline bool is_string() const { return m_type == type::string; }
+    inline bool is_int() const { return m_type == type::integer; }
+    inline bool is_double() const { return m_type == type::real; }
+    inline bool is_bool() const { return m_type == type::boolean; }
+    inline bool is_array() const { return m_type == type::array; }
+    inline bool is_object() const { return m_type == type::object; }
+
+    /**
+     * @brief Accessors.
+     * @throw bad_node_access if the node does not hold the requested type.
+     **/
+    inline std::string_view as_string() const
+    {
+        check(type::string);
+        return is_small() ? std::string_view(m_small.data, m_small.size) : std::string_view(m_large.data, m_large.size);
+    }
+    inline int as_int() const { check(type::integer); return m_int; }
+    inline double as_double() const { check(type::real); return m_double; }
+    inline bool as_bool() const { check(type::boolean); return m_bool; }
+    inline const ez::temp::array & as_array() const { check(type::array); return m_array; }
+    inline ez::temp::array & as_array() { check(type::array); return m_array; }
+    inline const ez::temp::object & as_object() const { check(type::object); return *m_object; }
+    inline ez::temp::object & as_object() { check(type::object); return *m_object; }
+
+    /**
+     * @brief Name of the held type ("null", "string", "int", ...).
+     **/
+    const char * type_name() const;
+
+private:
+
+    static constexpr std::size_t small_capacity = 23;
+    static constexpr std::uint8_t large_marker = 0xff;
+
+    struct small_string
+    {
+        char data[small_capacity];
+        std::uint8_t size;
+    };
+
+    struct large_string
+    {
+        char * data;
+        std::size_t size;
+    };
+
+    inline bool is_small() const { return m_small.size != large_marker; }
+
+    inline void check(node::type expected) const
+    {
+        if(m_type != expected)
+            bad_access(expected);
+    }
+
+    [[noreturn]] void bad_access(node::type expected) const;
+
+    void copy_from(const node & other);
+    void move_from(node & other) noexcept;
+    void destroy() noexcept;
+
+    union
+    {
+        int m_int;
+        double m_double;
+        bool m_bool;
+        small_string m_small;
+        large_string m_large;
+        ez::temp::array m_array;
+        ez::temp::object * m_object;
+    };
+    node::type m_type;
+};
+
+/**
+ * @brief Call @a visitor with the value held by @a value.
+ * The visitor is called with one of std::nullptr_t, std::string_view, int,
+ * double, bool, const array & or const object &.
+ **/
+template <typename Visitor>
+auto visit(Visitor && visitor, const node & value) -> decltype(visitor(nullptr))
+{
+    switch(value.kind())
+    {
+    case node::type::string: return visitor(value.as_string());
+    case node::type::integer: return visitor(value.as_int());
+    case node::type::real: return visitor(value.as_double());
+    case node::type::boolean: return visitor(value.as_bool());
+    case node::type::array: return visitor(value.as_array());
+    case node::type::object: return visitor(value.as_object());
+    default: return visitor(nullptr);
+    }
+}
 
 /**
  * @brief EZ Dict
  **/
-class dict: public std::map<const std::string, node>
+class dict: public ez::temp::object
 {
 public:
     dict(const std::initializer_list<std::pair<const std::string, node>> & init_lst)
@@ -50,11 +278,592 @@ public:
         }
     }
     dict() {}
+
+    /**
+     * @brief Parse the @a json object, nesting at most 512 objects and arrays.
+     * @throw std::runtime_error with the line and column of a syntax error.
+     **/
     static dict from_json(const std::string & json);
+
+    /**
+     * @brief Parse @a json into nodes allocated from @a memory (see memory_scope).
+     **/
+    static dict from_json(const std::string & json, std::pmr::memory_resource * memory);
+};
+
+/**
+ * @brief The sequence class
+ * Items of a loop produced one at a time by a context_provider, instead of
+ * being held by an array.
+ **/
+class sequence
+{
+public:
+    virtual ~sequence() {}
+
+    /**
+     * @brief The number of items, for loop.length, loop.last and loop.revindex.
+     **/
+    virtual std::size_t size() = 0;
+
+    /**
+     * @brief Move to the next item.
+     * @param item  Set to the item, which the loop body sees until the next call.
+     * @return false past the last item.
+     **/
+    virtual bool next(node & item) = 0;
+};
+
+/**
+ * @brief The context_provider class
+ * Values of a render context resolved on demand (see render_options::provider):
+ * the keys not found in the dict are asked to the provider when a tag, a
+ * condition or a loop first needs them. Values are kept for the rest of the
+ * render, so that each key path is asked at most once.
+ * Calls are serialized, parallel loops included. Sequences are not kept: each
+ * loop asks for its own.
+ **/
+class context_provider
+{
+public:
+    virtual ~context_provider() {}
+
+    /**
+     * @brief Get the value at a key path.
+     * The whole path is asked first (eg.: user.address.city), then its
+     * prefixes (user.address, then user), whose objects are looked into.
+     * @return false if there is no value at this path.
+     **/
+    virtual bool resolve(const std::vector<std::string> & keys, node & value) = 0;
+
+    /**
+     * @brief Get the items of the array at a key path, for a for loop.
+     * Loops over a sequence are never split.
+     * @return null to resolve() the array instead (default).
+     **/
+    virtual std::unique_ptr<sequence> iterate(const std::vector<std::string> & /*keys*/) { return nullptr; }
+};
+
+/**
+ * @brief The values a context_provider gave during a render.
+ **/
+class provided_values;
+
+/**
+ * @brief The scope class
+ * Layered rendering context: a loop scope shadows its parent with the loop
+ * variable and the @a loop attributes, both held by reference or in place,
+ * so that the caller's dict is never copied.
+ **/
+class scope
+{
+public:
+    /**
+     * @brief Root scope, looking up in @a context.
+     * @param provided  The values of a context_provider, for the keys missing from @a context.
+     **/
+    scope(const dict & context, provided_values * provided = nullptr);
+
+    /**
+     * @brief Loop scope, binding @a name on top of @a parent.
+     * @param length    The number of iterations of the loop.
+     * @param first     The index of the first iteration next() moves to,
+     *                  for a scope rendering a chunk of the loop.
+     **/
+    scope(const scope & parent, const std::string & name, int length, int first = 0);
+
+    /**
+     * @brief Move to the next loop iteration.
+     * @param value     The loop variable value (must outlive the iteration).
+     **/
+    void next(const node & value);
+
+    /**
+     * @brief Find the node at the given key path.
+     * @throw std::out_of_range if the path does not exist.
+     **/
+    const node & at(const std::vector<std::string> & keys) const;
+
+    /**
+     * @brief Find the node at the given key path.
+     * @return nullptr if the path does not exist.
+     **/
+    const node * find(const std::vector<std::string> & keys) const;
+
+    /**
+     * @brief The sequence of a context_provider at the given key path, if any.
+     **/
+    std::unique_ptr<sequence> iterate(const std::vector<std::string> & keys) const;
+
+private:
+    const node * lookup(const std::vector<std::string> & keys, std::size_t & level) const;
+
+    const dict * m_context;
+    provided_values * m_provided;   ///< shared by the loop scopes
+    const scope * m_parent;
+    const std::string * m_name;
+    const node * m_value;
+    node m_loop;
+    int m_index;
+};
+
+/**
+ * @brief The output_sink class
+ * Destination of the rendered text, written piece by piece.
+ **/
+class output_sink
+{
+public:
+    virtual ~output_sink() {}
+    virtual void write(const char * data, std::size_t size) = 0;
+    virtual void flush() {}
+    inline void write(std::string_view str) { write(str.data(), str.size()); }
+};
+
+/**
+ * @brief The string_sink class
+ * Appends to a string.
+ **/
+class string_sink : public output_sink
+{
+public:
+    string_sink(std::string & output): m_output(output) {}
+    void write(const char * data, std::size_t size) override { m_output.append(data, size); }
+private:
+    std::string & m_output;
+};
+
+/**
+ * @brief The pmr_string_sink class
+ * Appends to a string allocated from a memory resource.
+ **/
+class pmr_string_sink : public output_sink
+{
+public:
+    pmr_string_sink(std::pmr::string & output): m_output(output) {}
+    void write(const char * data, std::size_t size) override { m_output.append(data, size); }
+private:
+    std::pmr::string & m_output;
+};
+
+/**
+ * @brief The ostream_sink class
+ * Writes to a standard output stream.
+ **/
+class ostream_sink : public output_sink
+{
+public:
+    ostream_sink(std::ostream & output): m_output(output) {}
+    void write(const char * data, std::size_t size) override { m_output.write(data, size); }
+    void flush() override { m_output.flush(); }
+private:
+    std::ostream & m_output;
+};
+
+/**
+ * @brief The callback_sink class
+ * Forwards each written piece to a callback.
+ **/
+class callback_sink : public output_sink
+{
+public:
+    using callback = std::function<void(const char *, std::size_t)>;
+    callback_sink(const callback & cb): m_callback(cb) {}
+    void write(const char * data, std::size_t size) override { m_callback(data, size); }
+private:
+    callback m_callback;
+};
+
+/**
+ * @brief The fd_sink class
+ * Buffered writer on a file descriptor, flushed each time the buffer
+ * exceeds @a threshold bytes and on destruction.
+ **/
+class fd_sink : public output_sink
+{
+public:
+    fd_sink(int fd, std::size_t threshold = 64 * 1024);
+    ~fd_sink();
+    void write(const char * data, std::size_t size) override;
+    void flush() override;
+private:
+    int m_fd;
+    std::size_t m_threshold;
+    std::string m_buffer;
+};
+
+/**
+ * @brief Template rendering function definition.
+ **/
+using render_function = std::function<std::string(const array &)>;
+
+/**
+ * @brief The function_registry class
+ * Template rendering functions by name.
+ * Functions are resolved when templates are compiled, so rendering never
+ * looks the registry up. Until frozen, lookups and additions are serialized;
+ * once frozen, the registry is immutable and lookups are lock-free.
+ **/
+class EZTEMP_EXPORT function_registry
+{
+public:
+    function_registry(): m_frozen(false) {}
+
+    /**
+     * @brief Add (or replace) a function.
+     * @throw std::logic_error if the registry is frozen.
+     **/
+    void add(const std::string & key, const render_function & function);
+
+    /**
+     * @brief Make the registry immutable.
+     **/
+    void freeze();
+
+    inline bool frozen() const { return m_frozen.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Find a function.
+     * @return The function, valid for the registry lifetime, or nullptr.
+     **/
+    const render_function * find(const std::string & key) const;
+
+private:
+    std::map<std::string, render_function> m_functions;
+    mutable std::mutex m_mutex;
+    std::atomic<bool> m_frozen;
+};
+
+/**
+ * @brief The fragment_cache class
+ * Rendered fragments of {% cache key ttl %} sections by key, in a bounded
+ * LRU. Entries expire after their time to live, and the least recently used
+ * ones are evicted beyond the entry count or total size limits.
+ * All the members are thread safe. Renders missing the same key at the same
+ * time each render the fragment, the last one is kept.
+ **/
+class EZTEMP_EXPORT fragment_cache
+{
+public:
+    /**
+     * @brief Counters since the creation (or reset_statistics()), and current size.
+     **/
+    struct statistics
+    {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;      ///< dropped for the limits
+        std::size_t expirations = 0;    ///< dropped after their time to live
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    static constexpr std::size_t default_max_entries = 1024;
+    static constexpr std::size_t default_max_bytes = 16 * 1024 * 1024;
+
+    fragment_cache(std::size_t max_entries = default_max_entries, std::size_t max_bytes = default_max_bytes);
+
+    /**
+     * @brief Find a fragment, counting a hit or a miss.
+     * @return The fragment, or nullptr if it is missing or expired.
+     **/
+    std::shared_ptr<const std::string> find(const std::string & key);
+
+    /**
+     * @brief Add (or replace) a fragment.
+     * @param ttl   Time to live in seconds, 0 for no expiry.
+     * Fragments larger than the size limit are not stored.
+     **/
+    void insert(const std::string & key, std::string fragment, double ttl = 0);
+
+    /**
+     * @brief Drop a fragment.
+     * @return false if there was none.
+     **/
+    bool invalidate(const std::string & key);
+
+    /**
+     * @brief Drop every fragment.
+     **/
+    void clear();
+
+    /**
+     * @brief Change the limits, evicting entries beyond them.
+     **/
+    void set_limits(std::size_t max_entries, std::size_t max_bytes);
+
+    statistics stats() const;
+    void reset_statistics();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct entry
+    {
+        std::string key;
+        std::shared_ptr<const std::string> fragment;
+        clock::time_point expires;  ///< max() for no expiry
+    };
+
+    void erase(std::list<entry>::iterator it);
+    void shrink();
+
+    mutable std::mutex m_mutex;
+    std::list<entry> m_entries;     ///< most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+    std::size_t m_max_entries;
+    std::size_t m_max_bytes;
+    statistics m_stats;
+};
+
+/**
+ * @brief Operation codes of a compiled template instruction.
+ **/
+enum class opcode {
+    text, render,
+    for_loop, endfor, if_test, else_branch, endif,
+    block, endblock, extends, cache, endcache, unknown,
+};
+
+/**
+ * @brief Instruction sets the lexer can scan for delimiters with.
+ **/
+enum class lexer_isa {
+    scalar, sse2, avx2,
+};
+
+inline std::vector<std::string> split(const std::string &text, char sep) {
+  std::vector<std::string> tokens;
+  std::size_t start = 0, end = 0;
+  while ((end = text.find(sep, start)) != std::string::npos) {
+    tokens.push_back(text.substr(start, end - start));
+    start = end + 1;
+  }
+  tokens.push_back(text.substr(start));
+  return tokens;
+}
+
+/**
+ * @brief The template_source class
+ * Immutable text of a template, memory mapped from a file or owned.
+ * Text tokens are views into it, and compiled templates keep their
+ * sources alive.
+ * A mapped file must not be truncated in place while it is in use;
+ * editors replacing the file (new inode) are fine.
+ **/
+class EZTEMP_EXPORT template_source
+{
+public:
+    /**
+     * @brief Files from this size on are memory mapped by default, smaller ones are read.
+     **/
+    static constexpr std::size_t default_mmap_threshold = 64 * 1024;
+
+    /**
+     * @brief Load a template file.
+     * @param path              The file path.
+     * @param mmap_threshold    Map the file if it is at least this long, read it otherwise.
+     * @throw renderer::compile_exception if the file cannot be read.
+     **/
+    static std::shared_ptr<const template_source> from_file(const std::string & path,
+                                                            std::size_t mmap_threshold = default_mmap_threshold);
+
+    /**
+     * @brief Hold a template string.
+     **/
+    static std::shared_ptr<const template_source> from_string(std::string text);
+
+    template_source(const template_source &) = delete;
+    template_source & operator=(const template_source &) = delete;
+    ~template_source();
+
+    inline std::string_view text() const { return m_text; }
+    inline bool is_mapped() const { return m_mapping != nullptr; }
+    /**
+     * @brief The file the source was loaded from, empty for a string.
+     **/
+    inline const std::string & path() const { return m_path; }
+
+protected:
+    template_source() {}
+
+private:
+    std::string m_path;
+    std::string m_owned;
+    std::string_view m_text;
+    void * m_mapping = nullptr;
+};
+
+/**
+ * @brief Sources a compiled template refers to.
+ **/
+using source_list = std::vector<std::shared_ptr<const template_source>>;
+
+/**
+ * @brief The expression class
+ * Arithmetic, comparison and boolean expression of a tag, such as
+ * {{ price * quantity }} or {% if loop.index > 1 and name != 'root' %}.
+ * Parsed once by ez::expr, evaluated against a scope:
+ *  - variables are dotted key paths of the scope, a value of the scope
+ *    named like a constant of ez::expr (e, pi...) takes precedence over it,
+ *  - integers stay integers through + - *, / and the math functions give reals,
+ *  - + concatenates strings, and numbers to strings,
+ *  - == and != compare values of different types as unequal, < <= > >=
+ *    compare numbers or strings,
+ *  - and, or and not short-circuit, a lone variable is tested as {% if key %} does.
+ * Copies share the parsed expression.
+ **/
+class EZTEMP_EXPORT expression
+{
+public:
+    /**
+     * @brief Parse an expression.
+     * @throw renderer::compile_exception on a syntax error.
+     **/
+    expression(const std::string & source);
+
+    /**
+     * @brief Write the value of the expression the way {{ key }} does.
+     * @throw renderer::render_exception on a missing variable or a type error.
+     **/
+    void render(const scope & context, output_sink & output) const;
+
+    /**
+     * @brief Evaluate the expression as a condition.
+     * @throw renderer::render_exception on a missing variable or a type error.
+     **/
+    bool test(const scope & context) const;
+
+    const std::string & source() const;
+
+    /**
+     * @brief Whether the expression has no variables, its value is then the same in any context.
+     **/
+    bool is_constant() const;
+
+    /**
+     * @brief Whether @a source is a plain dotted key path (eg.: "user.first-name").
+     * Key paths may contain '-', "a-b" is a key while "a - b" is a subtraction.
+     * true, false and the constants of ez::expr (e, pi...) are parsed.
+     **/
+    static bool is_key_path(const std::string & source);
+
+private:
+    struct program;
+    expression(std::shared_ptr<const program> prog): m_program(std::move(prog)) {}
+    std::shared_ptr<const program> m_program;
+
+    friend class template_serializer;   // allow .ezc files to hold the parsed expression.
+};
+
+/**
+ * @brief The text_token class
+ **/
+class text_token
+{
+public:
+    text_token(std::string_view text): m_text(text) {}
+    inline std::string_view text() const { return m_text; }
+    inline void render(const scope & /*context*/, output_sink & output) const { output.write(m_text); }
+private:
+    std::string_view m_text;    // into a template_source
+};
+
+/**
+ * @brief The render_token class
+ **/
+class render_token
+{
+public:
+    render_token(const std::string & content);
+    void render(const scope & context, output_sink & output) const;
+    inline const std::string & content() const { return m_content; }
+    inline bool is_function() const { return !m_function.empty(); }
+    inline bool is_expression() const { return m_expression.has_value(); }
+    inline const std::string & function() const { return m_function; }
+    inline const ez::temp::expression & expression() const { return *m_expression; }
+    inline const std::vector<std::string> & keys() const { return m_keys; }
+    inline const std::vector<std::vector<std::string>> & arguments() const { return m_arguments; }
+    static bool is_start(std::string::const_iterator start, const std::string::const_iterator & end);
+    static bool is_end(std::string::const_iterator start, const std::string::const_iterator & end);
+    static inline const std::string & start_tag() { return m_start_tag; }
+    static inline const std::string & end_tag() { return m_end_tag; }
+private:
+    render_token(): m_callable(nullptr) {}
+
+    std::string m_content;
+    std::string m_function;                             ///< function name, empty for a lookup
+    const render_function * m_callable;                 ///< resolved function
+    std::vector<std::string> m_keys;                    ///< dotted key path of a lookup
+    std::vector<std::vector<std::string>> m_arguments;  ///< key paths of the function arguments
+    std::optional<ez::temp::expression> m_expression;   ///< anything else
+    static std::string m_start_tag;
+    static std::string m_end_tag;
+
+    friend class template_serializer;   // allow .ezc files to hold the parsed token.
+};
+
+/**
+ * @brief The section_token class
+ **/
+class section_token
+{
+public:
+    section_token(const std::string & content);
+    inline const std::string & content() const { return m_content; }
+    inline const std::vector<std::string> & params() const { return m_params; }
+    inline ez::temp::opcode op() const { return m_op; }
+    /**
+     * @brief Whether a for_loop section is marked "parallel".
+     **/
+    inline bool is_parallel() const { return m_parallel; }
+    /**
+     * @brief The key path of the array of a for_loop section.
+     **/
+    inline const std::vector<std::string> & loop_keys() const { return m_loop_keys; }
+    /**
+     * @brief The key expression of a cache section.
+     **/
+    inline const ez::temp::expression & key() const { return *m_key; }
+    /**
+     * @brief The time to live of a cache section in seconds, 0 for no expiry.
+     **/
+    inline double ttl() const { return m_ttl; }
+    /**
+     * @brief The condition of an if_test section.
+     **/
+    inline const ez::temp::expression & condition() const { return *m_condition; }
+    static bool is_start(std::string::const_iterator start, const std::string::const_iterator & end);
+    static bool is_end(std::string::const_iterator start, const std::string::const_iterator & end);
+    static inline const std::string & start_tag() { return m_start_tag; }
+    static inline const std::string & end_tag() { return m_end_tag; }
+private:
+    section_token() {}
+
+    std::string m_content;
+    std::vector <std::string> m_params;
+    ez::temp::opcode m_op;
+    bool m_parallel = false;
+    std::vector<std::string> m_loop_keys;
+    double m_ttl = 0;
+    std::optional<ez::temp::expression> m_condition;
+    std::optional<ez::temp::expression> m_key;
+    static std::string m_start_tag;
+    static std::string m_end_tag;
+
+    friend class template_serializer;   // allow .ezc files to hold the parsed token.
 };
 
 /**
  * @brief The token class
+ * A template element held by value: a text, render or section token,
+ * dispatched on its opcode.
+ * Once linked in a compiled_template, control sections hold the index of
+ * their matching partner in @a jump:
+ *  - for_loop, cache: the matching endfor/endcache,
+ *  - if_test: the matching else (or endif if there is no else),
+ *  - else_branch: the matching endif,
+ *  - endfor, endif, endcache: the matching for_loop/if_test/cache.
  **/
 class token
 {
@@ -62,78 +871,217 @@ public:
     enum class type {
         text, render, section,
     };
-    token(token::type _type): m_type(_type) {}
-    inline const token::type token_type() { return m_type; }
-    virtual std::string render(const dict & context) = 0;
+    token(text_token && tok, const char * position = nullptr):
+        m_op(opcode::text), m_jump(-1), m_position(position ? position : tok.text().data()), m_payload(std::move(tok)) {}
+    token(render_token && tok, const char * position = nullptr):
+        m_op(opcode::render), m_jump(-1), m_position(position), m_payload(std::move(tok)) {}
+    token(section_token && tok, const char * position = nullptr):
+        m_op(tok.op()), m_jump(-1), m_position(position), m_payload(std::move(tok)) {}
+    inline token::type token_type() const { return static_cast<token::type>(m_payload.index()); }
+    inline ez::temp::opcode op() const { return m_op; }
+    inline int jump() const { return m_jump; }
+    /**
+     * @brief Where the token was lexed in its template_source, null if unknown.
+     **/
+    inline const char * position() const { return m_position; }
+    inline const text_token & text() const { return *std::get_if<text_token>(&m_payload); }
+    inline const render_token & render() const { return *std::get_if<render_token>(&m_payload); }
+    inline const section_token & section() const { return *std::get_if<section_token>(&m_payload); }
+private:
+    ez::temp::opcode m_op;
+    int m_jump;
+    const char * m_position;
+    std::variant<text_token, render_token, section_token> m_payload;
+
+    friend class compiled_template; // allow compiled_template to link jumps.
+    friend class template_serializer;   // allow .ezc files to drop the positions.
+};
+
+/**
+ * @brief List of rendering tokens.
+ **/
+using token_list = std::vector<token>;
+
+/**
+ * @brief The compiled_template class
+ * Linked tokens, stored contiguously and rendered in a single forward pass.
+ **/
+class compiled_template: public std::vector<token>
+{
+public:
+    compiled_template() {}
+
+    /**
+     * @brief Link tokens.
+     * @param sources   The sources the text tokens are views into.
+     **/
+    explicit compiled_template(token_list tokens, source_list sources = source_list());
+
+    inline const source_list & sources() const { return m_sources; }
+
+    /**
+     * @brief Rewrite the tokens so that there are fewer of them to render:
+     *  - adjacent texts are merged,
+     *  - tags of constant expressions are rendered to text,
+     *  - if sections with a constant condition are replaced by the taken branch,
+     *  - empty texts and the sections rendering nothing (block, endblock,
+     *    extends, unknown) are dropped.
+     * The output is unchanged, but for errors of constant expressions which
+     * are left to be raised at render time. Merged texts are held by a source
+     * owned by the template.
+     * Called by renderer::compile and renderer::compile_file.
+     * @return The number of tokens removed by this call.
+     **/
+    std::size_t optimize();
+
+    /**
+     * @brief The number of tokens removed by the calls to optimize().
+     **/
+    inline std::size_t removed_tokens() const { return m_removed; }
+
+    /**
+     * @brief Write the template in the binary .ezc format: the tokens with
+     * their sections and expressions parsed, the texts, and the size and
+     * modification time of the template files it was compiled from.
+     * @throw renderer::compile_exception if the file cannot be written.
+     **/
+    void save(const std::string & path) const;
+
+    /**
+     * @brief Load a template written by save().
+     * The file is read (mapped if large) and its texts used in place, only
+     * the template functions are looked up again. The tokens have no position.
+     * @param check     Check the template files it was compiled from.
+     * @throw renderer::stale_exception if one of them changed since.
+     * @throw renderer::compile_exception if the file cannot be read, is not
+     *        an .ezc file of this version, or calls an unknown function.
+     **/
+    static compiled_template load(const std::string & path, bool check = true);
+
+    /**
+     * @brief The version of the .ezc format written by save().
+     **/
+    static constexpr std::uint32_t binary_version = 1;
+
 private:
-    type m_type;
+    void link();
+
+    source_list m_sources;
+    std::size_t m_removed = 0;
+
+    friend class template_serializer;   // allow .ezc files to restore the removed tokens count.
 };
 
-inline std::vector<std::string> split(const std::string &text, char sep) {
-  std::vector<std::string> tokens;
-  std::size_t start = 0, end = 0;
-  while ((end = text.find(sep, start)) != std::string::npos) {
-    tokens.push_back(text.substr(start, end - start));
-    start = end + 1;
-  }
-  tokens.push_back(text.substr(start));
-  return tokens;
-}
+/**
+ * @brief The render_profile class
+ * Calls, time and output bytes of each token of a template, added up over
+ * the renders given the profile in render_options::profile.
+ * The counters of a for or cache section include its body, those of an
+ * if section only its test: total() and self() tell the time and bytes
+ * of a section with and without its body.
+ * Profiling is off unless a profile is given, the renders without one
+ * run unchanged code. A profile must not be shared by concurrent renders.
+ **/
+class EZTEMP_EXPORT render_profile
+{
+public:
+    struct counters
+    {
+        std::uint64_t calls = 0;
+        std::uint64_t nanoseconds = 0;
+        std::uint64_t bytes = 0;        ///< written
+    };
+
+    /**
+     * @brief Where a token was written.
+     **/
+    struct location
+    {
+        std::string file;   ///< empty for a template string
+        int line = 0;       ///< from 1, 0 if unknown
+    };
+
+    /**
+     * @param input     The profiled template, which must outlive the profile.
+     **/
+    explicit render_profile(const compiled_template & input);
+
+    inline const compiled_template & program() const { return m_program; }
+    inline const std::vector<counters> & tokens() const { return m_counters; }
+    inline counters & at(int index) { return m_counters[index]; }
+
+    /**
+     * @brief The counters of a token, with its body.
+     **/
+    counters total(int index) const;
+
+    /**
+     * @brief The counters of a token, without its body.
+     **/
+    counters self(int index) const;
+
+    /**
+     * @brief The location of each token, found from the sources of the template.
+     **/
+    std::vector<location> locate() const;
+
+    /**
+     * @brief Write the called tokens, the slowest (by self time) first.
+     * @param limit     Most rows written, 0 for all.
+     **/
+    void write_table(std::ostream & out, std::size_t limit = 0) const;
+
+    /**
+     * @brief Write the self time of the tokens as folded stacks of their
+     * sections ("frame;frame;frame nanoseconds" lines), as read by
+     * flamegraph.pl or speedscope.
+     **/
+    void write_folded(std::ostream & out) const;
+
+    void clear();
 
-/**
- * @brief The text_token class
- **/
-class text_token : public token
-{
-public:
-    text_token(const std::string & text): token(token::type::text), m_text(text) {}
-    std::string render(const dict & context) override { return m_text; }
 private:
-    std::string m_text;
+    /**
+     * @brief The index after the body of the section at @a index, @a index + 1 for other tokens.
+     **/
+    int body_end(int index) const;
+
+    const compiled_template & m_program;
+    std::vector<counters> m_counters;
 };
 
 /**
- * @brief The render_token class
+ * @brief Options of a render call.
+ * Loops over at least 2 * @a min_chunk items can be split into chunks
+ * rendered on a shared worker pool, then written out in order. This is
+ * enabled for every loop with @a parallel, or per loop with
+ * {% for x in xs parallel %}. Loops nested in a chunk run sequentially.
+ * Template functions are then called from several threads.
  **/
-class render_token : public token
+struct render_options
 {
-public:
-    render_token(const std::string & content);
-    std::string render(const dict& context) override;
-    static bool is_start(std::string::const_iterator start, const std::string::const_iterator & end);
-    static bool is_end(std::string::const_iterator start, const std::string::const_iterator & end);
-    static inline const std::string & start_tag() { return m_start_tag; }
-    static inline const std::string & end_tag() { return m_end_tag; }
-private:
-    std::string m_content;
-    static std::string m_start_tag;
-    static std::string m_end_tag;
+    bool parallel = false;          ///< split every large enough loop
+    unsigned threads = 0;           ///< threads per loop, the caller's included (0: hardware concurrency)
+    std::size_t min_chunk = 256;    ///< fewest iterations per chunk
+    render_profile * profile = nullptr;     ///< collects the time spent in each token, loops are then sequential
+    context_provider * provider = nullptr;  ///< resolves the keys missing from the context, on demand
+    std::pmr::memory_resource * memory = nullptr;   ///< loop scopes and function arguments allocate from it, parallel loop workers through a lock (see memory_scope)
 };
 
 /**
- * @brief The section_token class
+ * @brief Options of a batch render.
  **/
-class section_token : public token
+struct batch_options
 {
-public:
-    section_token(const std::string & content);
-    std::string render(const dict& context) override { return ""; }
-    inline const std::vector<std::string> & params() const { return m_params; }
-    static bool is_start(std::string::const_iterator start, const std::string::const_iterator & end);
-    static bool is_end(std::string::const_iterator start, const std::string::const_iterator & end);
-    static inline const std::string & start_tag() { return m_start_tag; }
-    static inline const std::string & end_tag() { return m_end_tag; }
-private:
-    std::string m_content;
-    std::vector <std::string> m_params;
-    static std::string m_start_tag;
-    static std::string m_end_tag;
+    unsigned threads = 0;   ///< rendering threads, the caller's included (0: hardware concurrency)
+    bool ordered = true;    ///< call back in context order from the calling thread, or as done from the workers
 };
 
 /**
- * @brief List of rendering tokens.
+ * @brief Receives the output of each context of a batch.
+ * The output is only valid during the call.
  **/
-using compiled_template = std::vector<std::shared_ptr<token>>;
+using batch_callback = std::function<void(std::size_t index, std::string_view output)>;
 
 /**
  * @brief The renderer class.
@@ -151,20 +1099,61 @@ public:
         }
     };
 
+    class compile_exception: public std::runtime_error
+    {
+    public:
+        compile_exception(const char * what):
+            std::runtime_error(what)
+        {
+        }
+    };
+
+    /**
+     * @brief Thrown when a precompiled template is older than its template files.
+     **/
+    class stale_exception: public compile_exception
+    {
+    public:
+        stale_exception(const char * what, const std::string & source):
+            compile_exception(what),
+            m_source(source)
+        {
+        }
+        /**
+         * @brief The template file the precompiled template was compiled from.
+         **/
+        inline const std::string & source() const { return m_source; }
+    private:
+        std::string m_source;
+    };
+
     /**
      * @brief Compile a template string.
      * @param input The input string.
      * @param path  The path to find extends templates.
+     * @param optimize  Run compiled_template::optimize().
+     * @return The compiled template.
+     **/
+    static compiled_template compile(const std::string & input, const std::string & path = "", bool optimize = true);
+
+    /**
+     * @brief Compile a template string, taking it over instead of copying it.
+     * @param input The input string.
+     * @param path  The path to find extends templates.
+     * @param optimize  Run compiled_template::optimize().
      * @return The compiled template.
      **/
-    static compiled_template compile(const std::string & input, const std::string & path = "");
+    static compiled_template compile(std::string && input, const std::string & path = "", bool optimize = true);
 
     /**
      * @brief Compile a template file.
+     * Large files are memory mapped (see template_source), the text
+     * tokens then refer to the mapping.
      * @param filepath  The path of the template file.
+     * @param optimize  Run compiled_template::optimize().
      * @return The compiled template.
      **/
-    static compiled_template compile_file(const std::string & filepath);
+    static compiled_template compile_file(const std::string & filepath, bool optimize = true);
 
     /**
      * @brief Render a template file.
@@ -174,6 +1163,14 @@ public:
      **/
     static std::string render_file(const std::string & filepath, const std::string & context);
 
+    /**
+     * @brief Render a template file into a sink.
+     * @param filepath  The path of the template file.
+     * @param context   The context as Json string.
+     * @param output    The output sink.
+     **/
+    static void render_file(const std::string & filepath, const std::string & context, output_sink & output);
+
     /**
      * @brief Render a template string.
      * @param input     The input string.
@@ -190,6 +1187,14 @@ public:
      **/
     static std::string render(const std::string & input, const std::string & context);
 
+    /**
+     * @brief Render a template string into a sink.
+     * @param input     The input string.
+     * @param context   The context as Json string.
+     * @param output    The output sink.
+     **/
+    static void render(const std::string & input, const std::string & context, output_sink & output);
+
     /**
      * @brief Render a compiled template.
      * @param input     The compiled template.
@@ -198,31 +1203,400 @@ public:
      */
     static std::string render(const ez::temp::compiled_template & input, const dict & context);
 
+    /**
+     * @brief Render a compiled template into a sink.
+     * @param input     The compiled template.
+     * @param context   The context dictionnary.
+     * @param output    The output sink.
+     */
+    static void render(const ez::temp::compiled_template & input, const dict & context, output_sink & output);
+
+    /**
+     * @brief Render a compiled template into a sink, with options.
+     * @param input     The compiled template.
+     * @param context   The context dictionnary.
+     * @param output    The output sink, only written from the calling thread.
+     * @param options   Parallel loop settings.
+     */
+    static void render(const ez::temp::compiled_template & input, const dict & context, output_sink & output,
+                       const render_options & options);
+
+    /**
+     * @brief Render a compiled template into a stream.
+     * @param input     The compiled template.
+     * @param context   The context dictionnary.
+     * @param output    The output stream.
+     */
+    static void render(const ez::temp::compiled_template & input, const dict & context, std::ostream & output);
+
+    /**
+     * @brief Render a compiled template once per context, on the worker pool.
+     * With batch_options::ordered (the default) outputs are buffered a window
+     * at a time and @a callback is called in order from the calling thread,
+     * otherwise it is called concurrently from the workers as soon as each
+     * output is rendered. Loops are rendered sequentially.
+     * @throw render_exception naming the first failing context, once the
+     * contexts rendered along with it are done.
+     **/
+    static void render_batch(const ez::temp::compiled_template & input, const std::vector<dict> & contexts,
+                             const batch_callback & callback, const batch_options & options = batch_options());
+
+    /**
+     * @brief Render a compiled template once per Json context.
+     * The contexts are parsed on the workers too.
+     **/
+    static void render_batch(const ez::temp::compiled_template & input, const std::vector<std::string> & contexts,
+                             const batch_callback & callback, const batch_options & options = batch_options());
+
+    /**
+     * @brief Render a compiled template once per context.
+     * @return The outputs, in context order.
+     **/
+    static std::vector<std::string> render_batch(const ez::temp::compiled_template & input, const std::vector<dict> & contexts,
+                                                 const batch_options & options = batch_options());
+
     /**
      * @brief Template rendering function definition.
      **/
-    using render_function = std::function<std::string(const array)>;
+    using render_function = ez::temp::render_function;
 
     /**
      * @brief Add a template rendering function.
      * @param key       The key name of the given function.
      * @param function  The function to execute.
+     * @throw std::logic_error once the functions are frozen.
      **/
     static void add_function(const std::string & key, const render_function & function)
     {
-        m_functions[key] = function;
+        m_functions.add(key, function);
     }
 
-private:
+    /**
+     * @brief Freeze the template rendering functions.
+     * No function can be added afterwards, and templates can then be
+     * compiled from several threads without any locking.
+     **/
+    static void freeze_functions()
+    {
+        m_functions.freeze();
+    }
 
-    static std::string call_function(const std::string & key, const array & nodes)
+    /**
+     * @brief The template rendering functions.
+     **/
+    static const function_registry & functions()
+    {
+        return m_functions;
+    }
+
+    /**
+     * @brief The fragments of the {% cache %} sections.
+     * Keys are shared by all the templates: name the fragments apart
+     * (eg.: {% cache 'footer' 60 %}).
+     **/
+    static fragment_cache & cache()
     {
-        return m_functions[key](nodes);
+        return m_cache;
     }
 
-    static std::map<std::string, render_function> m_functions;
+    /**
+     * @brief Select the delimiter scanning implementation of the lexer.
+     * The fastest one supported by the CPU is selected by default.
+     * @return false if @a isa is not supported by this CPU (or build).
+     **/
+    static bool set_lexer_isa(lexer_isa isa);
+
+    /**
+     * @brief The delimiter scanning implementation in use.
+     **/
+    static lexer_isa current_lexer_isa();
+
+    /**
+     * @name Rendering primitives
+     * Shared by the renderer and the C++ code generated by cpp_generator.
+     **/
+    /// @{
+
+    /**
+     * @brief Write a value the way {{ key }} does.
+     **/
+    static void write_value(const node & value, output_sink & output);
+
+    /**
+     * @brief Evaluate a value the way {% if key %} does.
+     * null, false, 0, empty strings, arrays and objects, and the string "false"
+     * test false, any other value true.
+     **/
+    static bool test_value(const node & value);
+
+    /**
+     * @brief Evaluate a string the way {% if key %} does (see test_value).
+     **/
+    static bool test_string(std::string_view value);
+
+    /**
+     * @brief Find the array iterated by {% for x in key.path %}.
+     * @throw render_exception if the path does not exist or is not an array.
+     **/
+    static const array & loop_array(const scope & context, const std::vector<std::string> & keys);
+
+    /**
+     * @brief Find the value of {{ key.path }}.
+     * @throw render_exception naming the path if it does not exist or goes through a non-object.
+     **/
+    static const node & value_at(const scope & context, const std::vector<std::string> & keys);
+
+    /**
+     * @brief Find a template rendering function.
+     * @throw render_exception if no function is registered as @a name.
+     **/
+    static const render_function & function(const std::string & name);
+
+    /// @}
+
+private:
+
+    static token_list tokenize(std::shared_ptr<const template_source> source, const std::string & path, source_list & sources);
+
+    static token_list tokenize_file(const std::string & filepath, source_list & sources);
+
+    static token_list lex(std::string_view input);
+
+    static std::string extends_base(const token_list & tokens);
+
+    static token_list extend(token_list base_tokens, const token_list & tokens);
+
+    static function_registry m_functions;
+
+    static fragment_cache m_cache;
+
+    friend class environment;  // allow environment to lex and extend templates.
+};
+
+/**
+ * @brief The environment class
+ * Finds templates in a search path and caches them compiled, by canonical
+ * path. Extended layouts are cached too, so that all templates extending the
+ * same layout reuse its compiled tokens.
+ * Cache entries are invalidated when the template (or one of its extended
+ * layouts) changes on disk (modification time or size), or explicitly.
+ * Modification times are compared to the second: an edit keeping the size
+ * of a file within the second it was loaded in is not seen, invalidate() it.
+ **/
+class EZTEMP_EXPORT environment
+{
+public:
+
+    /**
+     * @brief Create an environment.
+     * @param search_path   The directories to look for templates in.
+     **/
+    environment(const std::vector<std::string> & search_path = {"."});
+
+    /**
+     * @brief Append a directory to the search path.
+     **/
+    void add_search_path(const std::string & path);
+
+    /**
+     * @brief Get a compiled template.
+     * @param name  The template file name, relative to the search path.
+     * @return The (possibly cached) compiled template.
+     **/
+    std::shared_ptr<const compiled_template> get_template(const std::string & name);
+
+    /**
+     * @brief Render a template.
+     * @param name      The template file name, relative to the search path.
+     * @param context   The context dictionnary.
+     * @param output    The output sink.
+     **/
+    void render(const std::string & name, const dict & context, output_sink & output,
+                const render_options & options = render_options());
+
+    /**
+     * @brief Render a template.
+     * @param name      The template file name, relative to the search path.
+     * @param context   The context dictionnary.
+     * @return The rendered template.
+     **/
+    std::string render(const std::string & name, const dict & context);
+
+    /**
+     * @brief Files a template is made of.
+     * @param name  The template file name, relative to the search path.
+     * @return The canonical paths of the template and of the layouts it extends.
+     **/
+    std::vector<std::string> dependencies(const std::string & name);
+
+    /**
+     * @brief Drop a template from the cache.
+     * Templates extending it are recompiled on their next use.
+     **/
+    void invalidate(const std::string & name);
+
+    /**
+     * @brief Drop all the cached templates.
+     **/
+    void clear();
+
+    /**
+     * @brief Check templates modification time and size on each use (default).
+     * May be called while other threads render.
+     **/
+    inline void set_auto_reload(bool auto_reload) { m_auto_reload = auto_reload; }
+
+    /**
+     * @brief Number of templates (or extended layouts) taken from the cache.
+     * A template extending a layout counts a hit for each of them, and a
+     * template compiled again counts a hit for its unchanged layout.
+     **/
+    inline std::size_t hits() const { return m_hits; }
+
+    /**
+     * @brief Number of templates (or extended layouts) compiled.
+     **/
+    inline std::size_t misses() const { return m_misses; }
+
+private:
+
+    struct entry
+    {
+        token_list tokens;
+        source_list sources;    // the text tokens point into
+        std::shared_ptr<const compiled_template> program;
+        std::time_t mtime;
+        std::uintmax_t size;
+        std::string base_path;
+        std::shared_ptr<const entry> base;
+    };
+
+    std::string resolve(const std::string & name, const std::string & relative_to) const;
+
+    std::shared_ptr<const entry> load(const std::string & canonical_path);
+
+    bool is_fresh(const entry & e, const std::string & canonical_path);
+
+    std::vector<std::string> m_search_path;
+    std::map<std::string, std::shared_ptr<const entry>> m_cache;
+    std::mutex m_mutex;
+    std::atomic<bool> m_auto_reload;
+    std::atomic<std::size_t> m_hits;
+    std::atomic<std::size_t> m_misses;
+};
+
+/**
+ * @brief The template_bundle class
+ * All the templates of a directory, compiled with their extends chain resolved
+ * and held by name, to be saved to a single .ezb archive and loaded at once.
+ * Layouts are compiled once for all the templates extending them, and the
+ * texts the templates have in common are stored once in the archive.
+ * Names are the paths of the template files relative to the directory, with
+ * '/' separators (eg.: "mail/welcome.txt.ez"), layouts out of the directory
+ * being held under their canonical path.
+ **/
+class EZTEMP_EXPORT template_bundle
+{
+public:
+    template_bundle() {}
+
+    /**
+     * @brief Compile every *.ez file of @a directory and of its subdirectories.
+     * Layouts are looked up as by an environment searching @a directory.
+     * @throw renderer::compile_exception if a template does not compile.
+     **/
+    static template_bundle compile_directory(const std::string & directory);
+
+    /**
+     * @brief Write the bundle to an .ezb archive.
+     * @throw renderer::compile_exception if the file cannot be written.
+     **/
+    void save(const std::string & path) const;
+
+    /**
+     * @brief Load all the templates of an archive written by save().
+     * Unlike compiled_template::load, the template files are not checked:
+     * the archive is all there is to deploy.
+     * @throw renderer::compile_exception if the file cannot be read, is not
+     *        an .ezb archive of this version, or calls an unknown function.
+     **/
+    static template_bundle load(const std::string & path);
+
+    /**
+     * @brief Get a template by name.
+     * @throw renderer::compile_exception if there is no such template.
+     **/
+    std::shared_ptr<const compiled_template> get_template(const std::string & name) const;
+
+    inline bool contains(const std::string & name) const { return m_templates.count(name) != 0; }
+    inline std::size_t size() const { return m_templates.size(); }
+
+    /**
+     * @brief The names of the templates, sorted.
+     **/
+    std::vector<std::string> names() const;
+
+    /**
+     * @brief The extends graph.
+     * @return The names of the template and of the layouts it extends, in
+     *         extends order.
+     * @throw renderer::compile_exception if there is no such template.
+     **/
+    std::vector<std::string> dependencies(const std::string & name) const;
+
+    void render(const std::string & name, const dict & context, output_sink & output,
+                const render_options & options = render_options()) const;
+    std::string render(const std::string & name, const dict & context) const;
+
+private:
+    struct entry
+    {
+        std::shared_ptr<const compiled_template> program;
+        std::string base;   ///< name of the extended template, empty if none
+    };
+
+    const entry & at(const std::string & name) const;
+
+    std::map<std::string, entry> m_templates;
+};
+
+/**
+ * @brief The cpp_generator class
+ * Translates a compiled template into a C++ header/source pair exposing a
+ * render function, which writes the text and looks the keys up directly
+ * (no tokenization nor section dispatch at runtime).
+ * The generated code only depends on eztemp.h and the eztemp library.
+ **/
+class EZTEMP_EXPORT cpp_generator
+{
+public:
+
+    /**
+     * @brief Create a generator.
+     * @param function  The generated function name, optionally namespace
+     *                  qualified (eg.: "app::render_index").
+     **/
+    cpp_generator(const std::string & function);
+
+    /**
+     * @brief Generate the C++ code of a template.
+     * @param input         The compiled template.
+     * @param header_name   The name the source includes the header with.
+     * @param header        The header output.
+     * @param source        The source output.
+     **/
+    void generate(const compiled_template & input, const std::string & header_name,
+                  std::ostream & header, std::ostream & source) const;
+
+    /**
+     * @brief Default function name of a template file (eg.: "index.html.ez" gives "render_index_html").
+     **/
+    static std::string function_name(const std::string & filepath);
+
+private:
 
-    friend class render_token; // allow render_token to use call_function.
+    std::vector<std::string> m_namespaces;
+    std::string m_function;
 };
 
 } // namespace temp
@@ -1,15 +1,143 @@
 #include <eztemp.h>
 
+#include "watch.h"
+
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <memory>
 
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 namespace po = boost::program_options;
 
+/**
+ * @brief Write @a basename.h and @a basename.cpp rendering the @a input template file.
+ * @param depfile   If not empty, a Makefile rule listing the template and its layouts.
+ **/
+void emit_cpp(const std::string & input, const std::string & basename, std::string function, const std::string & depfile)
+{
+    if(function.empty())
+        function = ez::temp::cpp_generator::function_name(input);
+
+    ez::temp::environment env;
+    std::shared_ptr<const ez::temp::compiled_template> prog = env.get_template(input);
+
+    std::ofstream header(basename + ".h");
+    std::ofstream source(basename + ".cpp");
+    ez::temp::cpp_generator(function).generate(*prog, boost::filesystem::path(basename + ".h").filename().string(), header, source);
+    if(!header || !source)
+        throw std::runtime_error("cannot write " + basename + ".h/.cpp");
+
+    if(!depfile.empty())
+    {
+        std::ofstream deps(depfile);
+        deps << basename << ".cpp " << basename << ".h:";
+        for(const std::string & file: env.dependencies(input))
+        {
+            deps << " " << file;
+        }
+        deps << std::endl;
+    }
+}
+
+/**
+ * @brief Render @a prog once per line of the newline delimited Json @a contexts.
+ * @param output    Output file name, "{}" standing for the context index (one
+ *                  file per context), or empty for @a out.
+ **/
+void batch(const ez::temp::compiled_template & prog, std::istream & contexts, const std::string & output,
+           std::ostream & out, unsigned threads)
+{
+    const std::size_t block = 64 * 1024;
+    const std::size_t placeholder = output.find("{}");
+
+    ez::temp::batch_options options;
+    options.threads = threads;
+    // files can be written from the workers, in any order
+    options.ordered = placeholder == std::string::npos;
+
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::string> lines;
+    std::string line;
+    bool more = true;
+    while(more)
+    {
+        lines.clear();
+        while(lines.size() < block && (more = static_cast<bool>(std::getline(contexts, line))))
+        {
+            if(line.find_first_not_of(" \t\r") != std::string::npos)
+                lines.push_back(std::move(line));
+        }
+
+        std::atomic<std::size_t> written(0);
+        ez::temp::renderer::render_batch(prog, lines, [&](std::size_t index, std::string_view text) {
+            if(options.ordered)
+            {
+                out.write(text.data(), text.size());
+            }
+            else
+            {
+                std::string path = output;
+                path.replace(placeholder, 2, std::to_string(count + index));
+                std::ofstream file(path, std::ios::binary);
+                file.write(text.data(), text.size());
+                if(!file)
+                    throw std::runtime_error("cannot write " + path);
+            }
+            written += text.size();
+        }, options);
+        count += lines.size();
+        bytes += written;
+    }
+    out.flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Rendered " << count << " contexts (" << bytes / 1e6 << " MB) in " << seconds * 1000 << " milliseconds: "
+              << count / seconds << " contexts/s, " << bytes / 1e6 / seconds << " MB/s." << std::endl;
+}
+
+/**
+ * @brief Compile the @a input template file (.ez) or string, or load it precompiled (.ezc).
+ * A stale precompiled template is compiled again from its template file.
+ * @param bundle    If not empty, an .ezb archive to take the template named @a input from.
+ **/
+std::shared_ptr<const ez::temp::compiled_template> load_template(const std::string & input, const std::string & bundle)
+{
+    if(!bundle.empty())
+    {
+        return ez::temp::template_bundle::load(bundle).get_template(input);
+    }
+    if(boost::ends_with(input, ".ezc"))
+    {
+        try
+        {
+            return std::make_shared<const ez::temp::compiled_template>(ez::temp::compiled_template::load(input));
+        }
+        catch(const ez::temp::renderer::stale_exception & e)
+        {
+            if(e.source().empty())
+                throw;
+            std::cerr << "Warning: " << e.what() << ", compiling it again." << std::endl;
+            return std::make_shared<const ez::temp::compiled_template>(ez::temp::renderer::compile_file(e.source()));
+        }
+    }
+    return std::make_shared<const ez::temp::compiled_template>(boost::ends_with(input, ".ez")
+        ? ez::temp::renderer::compile_file(input) : ez::temp::renderer::compile(input));
+}
+
+static double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
 std::string unescape(const std::string& s)
 {
   std::string res;
@@ -56,6 +184,21 @@ int main(int argc, char ** argv)
             ("input", po::value(&input), "Input (filename or string)")
             ("output", po::value<std::string>(), "Output <filename>")
             ("params,p", po::value(&params), "Json parameters (filename or string)")
+            ("emit-cpp", po::value<std::string>(), "Generate <basename>.h and <basename>.cpp rendering the input template file")
+            ("function", po::value<std::string>(), "Name of the generated render function (default: render_<file name>)")
+            ("depfile", po::value<std::string>(), "With --emit-cpp, write the template dependencies to <filename>")
+            ("batch", po::value<std::string>(), "Render once per line of a newline delimited Json <filename> (- for stdin), "
+                                                "to the output, or to one file per context if the output name has {} (the context index, blank lines skipped)")
+            ("threads", po::value<unsigned>()->default_value(0), "With --batch, rendering threads (0: all cores)")
+            ("profile", "Print the compile, Json loading and render times, and the time, calls and bytes of each token to stderr")
+            ("profile-folded", po::value<std::string>(), "Write the time of each token as folded stacks to <filename> (for flamegraph.pl)")
+            ("compile-only,c", "Write the compiled template to the output (default: <input>c), to be given as input (*.ezc) instead of the template")
+            ("bundle", po::value<std::string>(), "Compile every template of the input directory to the archive <filename> (*.ezb)")
+            ("from-bundle", po::value<std::string>(), "Take the template named by the input from the archive <filename>")
+            ("watch,w", "Render again when the template, its layouts or the params file change. "
+                        "The input may be a directory: each template is rendered to the output directory, less .ez")
+            ("debounce", po::value<unsigned>()->default_value(100), "With --watch, milliseconds without changes before rendering")
+            ("watch-rounds", po::value<std::size_t>()->default_value(0), "With --watch, stop after <n> changes (0: until interrupted)")
         ;
 
         po::variables_map vm;
@@ -73,7 +216,8 @@ int main(int argc, char ** argv)
             verbose = true;
         }
 
-        if(vm.count("output"))
+        // with --batch, an output name with {} is a pattern
+        if(vm.count("output") && !vm.count("compile-only") && !vm.count("bundle") && !vm.count("watch") && !(vm.count("batch") && vm["output"].as<std::string>().find("{}") != std::string::npos))
         {
             fout.open(vm["output"].as<std::string>());
             out = &fout;
@@ -81,6 +225,88 @@ int main(int argc, char ** argv)
 
         input = unescape(vm["input"].as<std::string>());
 
+        if(vm.count("emit-cpp"))
+        {
+            emit_cpp(input, vm["emit-cpp"].as<std::string>(),
+                     vm.count("function") ? vm["function"].as<std::string>() : std::string(),
+                     vm.count("depfile") ? vm["depfile"].as<std::string>() : std::string());
+            return 0;
+        }
+
+        const std::string bundle = vm.count("from-bundle") ? vm["from-bundle"].as<std::string>() : std::string();
+
+        if(vm.count("bundle"))
+        {
+            const std::string output = vm["bundle"].as<std::string>();
+            const ez::temp::template_bundle templates = ez::temp::template_bundle::compile_directory(input);
+            templates.save(output);
+            if(verbose)
+            {
+                std::cout << "Bundled " << templates.size() << " templates to " << output << ":" << std::endl;
+                for(const std::string & name: templates.names())
+                {
+                    std::vector<std::string> chain = templates.dependencies(name);
+                    std::cout << "  " << name;
+                    for(std::size_t index = 1; index < chain.size(); ++index)
+                        std::cout << " -> " << chain[index];
+                    std::cout << std::endl;
+                }
+            }
+            return 0;
+        }
+
+        if(vm.count("watch"))
+        {
+            const std::string output = vm.count("output") ? vm["output"].as<std::string>() : std::string();
+            watch_options options;
+            options.debounce = std::chrono::milliseconds(vm["debounce"].as<unsigned>());
+            options.max_rounds = vm["watch-rounds"].as<std::size_t>();
+            options.verbose = verbose;
+            watch(boost::filesystem::is_directory(input) ? watch_directory(input, output) : std::vector<watch_target>({{input, output}}),
+                  vm.count("params") ? unescape(vm["params"].as<std::string>()) : params, options);
+            return 0;
+        }
+
+        if(vm.count("compile-only"))
+        {
+            if(!vm.count("output") && !boost::ends_with(input, ".ez"))
+                throw std::runtime_error("an output file name is required to compile a string");
+            const std::string output = vm.count("output") ? vm["output"].as<std::string>() : input + "c";
+            const std::shared_ptr<const ez::temp::compiled_template> prog = load_template(input, bundle);
+            prog->save(output);
+            if(verbose)
+            {
+                std::cout << "Compiled " << prog->size() << " tokens (" << prog->removed_tokens() << " removed by the optimizer) to " << output << "." << std::endl;
+            }
+            return 0;
+        }
+
+        if(vm.count("batch"))
+        {
+            const std::string contexts = vm["batch"].as<std::string>();
+            const std::shared_ptr<const ez::temp::compiled_template> prog = load_template(input, bundle);
+            const std::string output = vm.count("output") ? vm["output"].as<std::string>() : std::string();
+            std::ifstream file;
+            if(contexts != "-")
+            {
+                file.open(contexts);
+                if(!file)
+                    throw std::runtime_error("cannot read " + contexts);
+            }
+            batch(*prog, contexts == "-" ? std::cin : file, output, *out, vm["threads"].as<unsigned>());
+            return 0;
+        }
+
+        const bool profiling = vm.count("profile") || vm.count("profile-folded");
+        const auto start = std::chrono::steady_clock::now();
+
+        const std::shared_ptr<const ez::temp::compiled_template> prog = load_template(input, bundle);
+        if(verbose)
+        {
+            std::cout << "Compiled " << prog->size() << " tokens (" << prog->removed_tokens() << " removed by the optimizer)." << std::endl;
+        }
+        const auto compiled = std::chrono::steady_clock::now();
+
         if(vm.count("params"))
         {
             params = unescape(vm["params"].as<std::string>());
@@ -91,29 +317,41 @@ int main(int argc, char ** argv)
                 params = std::string(std::istreambuf_iterator<char>(fs),std::istreambuf_iterator<char>());
             }
         }
+        const ez::temp::dict context = ez::temp::dict::from_json(params);
+        const auto loaded = std::chrono::steady_clock::now();
 
-        std::chrono::time_point<std::chrono::system_clock> start, end;
-
-        if(verbose)
+        ez::temp::render_options options;
+        std::unique_ptr<ez::temp::render_profile> profile;
+        if(profiling)
         {
-            start = std::chrono::system_clock::now();
+            profile = std::make_unique<ez::temp::render_profile>(*prog);
+            options.profile = profile.get();
         }
+        ez::temp::ostream_sink sink(*out);
+        ez::temp::renderer::render(*prog, context, sink, options);
+        const auto rendered = std::chrono::steady_clock::now();
 
-        if(boost::ends_with(input, ".ez"))
-        {
-            *out << ez::temp::renderer::render_file(input, params);
-        }
-        else
+        if(profiling)
         {
-            *out << ez::temp::renderer::render(input, params);
+            std::cerr << "Compiled in " << milliseconds(start, compiled) << " milliseconds, Json loaded in "
+                      << milliseconds(compiled, loaded) << " milliseconds, rendered in "
+                      << milliseconds(loaded, rendered) << " milliseconds." << std::endl;
+            if(vm.count("profile"))
+            {
+                profile->write_table(std::cerr);
+            }
+            if(vm.count("profile-folded"))
+            {
+                std::ofstream folded(vm["profile-folded"].as<std::string>());
+                profile->write_folded(folded);
+                if(!folded)
+                    throw std::runtime_error("cannot write " + vm["profile-folded"].as<std::string>());
+            }
         }
 
         if(verbose)
         {
-            end = std::chrono::system_clock::now();
-            double elapsed_milliseconds = std::chrono::duration_cast<std::chrono::microseconds>
-                                     (end-start).count()/1000.;
-            std::cout << "Generated in " << elapsed_milliseconds << " milliseconds." << std::endl;
+            std::cout << "Generated in " << milliseconds(start, rendered) << " milliseconds." << std::endl;
         }
 
         return 0;
@@ -0,0 +1,308 @@
+#include "watch.h"
+
+#include <eztemp.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+std::vector<watch_target> watch_directory(const std::string & input, const std::string & output)
+{
+    if(output.empty())
+        throw std::runtime_error("an output directory is required to watch a directory");
+
+    std::vector<watch_target> targets;
+    for(fs::recursive_directory_iterator it(input), end; it != end; ++it)
+    {
+        if(fs::is_regular_file(it->status()) && it->path().extension() == ".ez")
+        {
+            // index.html.ez -> <output>/index.html
+            fs::path relative = fs::relative(it->path(), input);
+            targets.push_back({it->path().string(), (fs::path(output) / relative.parent_path() / relative.stem()).string()});
+        }
+    }
+    std::sort(targets.begin(), targets.end(), [](const watch_target & lhs, const watch_target & rhs) {
+        return lhs.input < rhs.input;
+    });
+    return targets;
+}
+
+#ifdef __linux__
+
+namespace {
+
+using steady_clock = std::chrono::steady_clock;
+
+double milliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/**
+ * @brief The time a file was last written, with the precision of the file system.
+ **/
+std::chrono::system_clock::time_point modification_time(const std::string & path)
+{
+    struct stat status;
+    if(::stat(path.c_str(), &status) != 0)
+        return std::chrono::system_clock::now();
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds(status.st_mtim.tv_sec) + std::chrono::nanoseconds(status.st_mtim.tv_nsec)));
+}
+
+/**
+ * @brief The watcher class
+ * Watches the directories of the template files and of the params file, as
+ * editors often save by replacing the file.
+ **/
+class watcher
+{
+public:
+    watcher(const std::vector<watch_target> & targets, const std::string & params, const watch_options & options):
+        m_params(params),
+        m_options(options),
+        m_fd(::inotify_init1(IN_CLOEXEC))
+    {
+        if(m_fd < 0)
+            throw std::runtime_error(std::string("cannot watch files: ") + std::strerror(errno));
+        // changes are told by inotify: no need to check the files on each use
+        m_env.set_auto_reload(false);
+        for(const watch_target & target: targets)
+            m_targets.push_back({target, {}});
+        if(boost::algorithm::ends_with(m_params, ".json"))
+        {
+            m_params_file = fs::canonical(m_params).string();
+            watch_file(m_params_file);
+        }
+    }
+
+    ~watcher()
+    {
+        ::close(m_fd);
+    }
+
+    void run()
+    {
+        load_params();
+        for(target & t: m_targets)
+            render(t);
+
+        for(std::size_t round = 0; !m_options.max_rounds || round < m_options.max_rounds; ++round)
+        {
+            const std::set<std::string> saved = wait_for_changes();
+            const steady_clock::time_point start = steady_clock::now();
+
+            bool all = false;
+            for(const std::string & file: saved)
+            {
+                if(m_options.verbose)
+                    std::cerr << "Changed: " << file << std::endl;
+                if(file == m_params_file)
+                    all = true;
+                else
+                    m_env.invalidate(file);
+            }
+            if(all && !load_params())
+                continue;
+
+            for(target & t: m_targets)
+            {
+                std::string changed = all ? m_params_file : std::string();
+                for(const std::string & file: t.files)
+                {
+                    if(saved.count(file))
+                        changed = file;
+                }
+                if(changed.empty() || !render(t))
+                    continue;
+
+                // from the save to the output
+                const std::chrono::system_clock::time_point written = modification_time(changed);
+                std::cerr << "Rendered " << name(t) << " in " << milliseconds(steady_clock::now() - start) << " milliseconds, "
+                          << std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - written).count()
+                          << " milliseconds after " << changed << " was saved." << std::endl;
+            }
+        }
+    }
+
+private:
+    struct target
+    {
+        watch_target output;
+        std::vector<std::string> files;     ///< the canonical paths of the template and of its layouts
+    };
+
+    static std::string name(const target & t)
+    {
+        return t.output.output.empty() ? t.output.input : t.output.output;
+    }
+
+    bool load_params()
+    {
+        try
+        {
+            std::string json = m_params;
+            if(!m_params_file.empty())
+            {
+                std::ifstream fs(m_params_file);
+                json.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+            }
+            m_context = ez::temp::dict::from_json(json);
+            return true;
+        }
+        catch(const std::exception & e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    /**
+     * @brief Render a target, updating the files it is made of.
+     * @return false on error, reported.
+     **/
+    bool render(target & t)
+    {
+        try
+        {
+            // the layouts may have changed with the template
+            t.files = m_env.dependencies(t.output.input);
+            for(const std::string & file: t.files)
+                watch_file(file);
+
+            std::string text;
+            ez::temp::string_sink sink(text);
+            m_env.render(t.output.input, m_context, sink);
+            sink.flush();
+            if(t.output.output.empty())
+            {
+                std::cout << text << std::flush;
+            }
+            else
+            {
+                fs::path parent = fs::path(t.output.output).parent_path();
+                if(!parent.empty())
+                    fs::create_directories(parent);
+                std::ofstream file(t.output.output, std::ios::binary | std::ios::trunc);
+                file << text;
+                if(!file)
+                    throw std::runtime_error("cannot write " + t.output.output);
+            }
+            return true;
+        }
+        catch(const std::exception & e)
+        {
+            std::cerr << "Error: " << name(t) << ": " << e.what() << std::endl;
+            // keep watching the template, fixed later
+            if(t.files.empty() && fs::exists(t.output.input))
+            {
+                t.files.push_back(fs::canonical(t.output.input).string());
+                watch_file(t.files.back());
+            }
+            return false;
+        }
+    }
+
+    void watch_file(const std::string & file)
+    {
+        m_files.insert(file);
+        const std::string directory = fs::path(file).parent_path().string();
+        if(m_directories.count(directory))
+            return;
+        int wd = ::inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+        if(wd < 0)
+            throw std::runtime_error("cannot watch " + directory + ": " + std::strerror(errno));
+        m_directories.insert(directory);
+        m_watches[wd] = directory;
+    }
+
+    /**
+     * @brief Wait for changes of the watched files, until none happens for the debounce time.
+     **/
+    std::set<std::string> wait_for_changes()
+    {
+        std::set<std::string> result;
+        steady_clock::time_point last;
+        alignas(struct inotify_event) char buffer[16 * 1024];
+        for(;;)
+        {
+            int timeout = -1;
+            if(!result.empty())
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(last + m_options.debounce - steady_clock::now());
+                timeout = std::max(0, static_cast<int>(remaining.count()));
+            }
+            pollfd events = {m_fd, POLLIN, 0};
+            int count = ::poll(&events, 1, timeout);
+            if(count < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("cannot watch files: ") + std::strerror(errno));
+            }
+            if(count == 0)
+                return result;
+
+            ssize_t size = ::read(m_fd, buffer, sizeof(buffer));
+            if(size <= 0)
+                continue;
+            for(char * it = buffer; it < buffer + size; )
+            {
+                const struct inotify_event * event = reinterpret_cast<const struct inotify_event *>(it);
+                it += sizeof(struct inotify_event) + event->len;
+                auto watch = m_watches.find(event->wd);
+                if(watch == m_watches.end() || !event->len)
+                    continue;
+                std::string file = watch->second + "/" + event->name;
+                if(!m_files.count(file))
+                    continue;
+                last = steady_clock::now();
+                result.insert(std::move(file));
+            }
+        }
+    }
+
+    ez::temp::environment m_env;
+    std::vector<target> m_targets;
+    std::string m_params;
+    std::string m_params_file;      ///< canonical path, empty for a Json string
+    ez::temp::dict m_context;
+    watch_options m_options;
+    int m_fd;
+    std::set<std::string> m_files;              ///< canonical paths of the watched files
+    std::set<std::string> m_directories;        ///< their directories
+    std::map<int, std::string> m_watches;       ///< watch descriptor -> directory
+};
+
+} // namespace
+
+void watch(const std::vector<watch_target> & targets, const std::string & params, const watch_options & options)
+{
+    watcher(targets, params, options).run();
+}
+
+#else
+
+void watch(const std::vector<watch_target> &, const std::string &, const watch_options &)
+{
+    throw std::runtime_error("--watch needs inotify (Linux)");
+}
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * @file watch.h
+ * @brief eztemp-cc watch mode.
+ **/
+#ifndef __EZTEMP_CC_WATCH_H__
+#define __EZTEMP_CC_WATCH_H__
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A template rendered to a file by the watch mode.
+ **/
+struct watch_target
+{
+    std::string input;
+    std::string output;     ///< empty for stdout
+};
+
+struct watch_options
+{
+    std::chrono::milliseconds debounce = std::chrono::milliseconds(100);   ///< quiet time before rendering
+    std::size_t max_rounds = 0;     ///< stop after this many changes, 0 to run until interrupted
+    bool verbose = false;
+};
+
+/**
+ * @brief The targets of a directory: each template of @a input (and of its
+ * subdirectories) rendered to the same path in @a output, less ".ez".
+ **/
+std::vector<watch_target> watch_directory(const std::string & input, const std::string & output);
+
+/**
+ * @brief Render @a targets, then render them again each time one of their
+ * template files or the params file changes.
+ * Templates are kept compiled in memory, only those made of a changed file
+ * are compiled and rendered again. Errors are reported and the watch goes on.
+ * @param params    Json parameters: a *.json file, watched too, or a string.
+ **/
+void watch(const std::vector<watch_target> & targets, const std::string & params, const watch_options & options);
+
+#endif // __EZTEMP_CC_WATCH_H__
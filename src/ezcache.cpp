@@ -0,0 +1,118 @@
+#include <limits>
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// fragment_cache stuff
+//
+
+fragment_cache::fragment_cache(std::size_t max_entries, std::size_t max_bytes):
+    m_max_entries(max_entries),
+    m_max_bytes(max_bytes)
+{
+}
+
+std::shared_ptr<const std::string> fragment_cache::find(const std::string & key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if(it == m_index.end())
+    {
+        ++m_stats.misses;
+        return nullptr;
+    }
+    if(it->second->expires <= clock::now())
+    {
+        erase(it->second);
+        ++m_stats.expirations;
+        ++m_stats.misses;
+        return nullptr;
+    }
+    // move to the front
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    ++m_stats.hits;
+    return m_entries.front().fragment;
+}
+
+void fragment_cache::insert(const std::string & key, std::string fragment, double ttl)
+{
+    clock::time_point expires = clock::time_point::max();
+    if(ttl > 0)
+        expires = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(ttl));
+    auto value = std::make_shared<const std::string>(std::move(fragment));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if(it != m_index.end())
+        erase(it->second);
+    if(value->size() > m_max_bytes || !m_max_entries)
+        return;
+
+    m_entries.push_front(entry{key, std::move(value), expires});
+    m_index.emplace(key, m_entries.begin());
+    ++m_stats.entries;
+    m_stats.bytes += m_entries.front().fragment->size();
+    shrink();
+}
+
+bool fragment_cache::invalidate(const std::string & key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if(it == m_index.end())
+        return false;
+    erase(it->second);
+    return true;
+}
+
+void fragment_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_stats.entries = 0;
+    m_stats.bytes = 0;
+}
+
+void fragment_cache::set_limits(std::size_t max_entries, std::size_t max_bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_entries = max_entries;
+    m_max_bytes = max_bytes;
+    shrink();
+}
+
+fragment_cache::statistics fragment_cache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void fragment_cache::reset_statistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+    m_stats.expirations = 0;
+}
+
+void fragment_cache::erase(std::list<entry>::iterator it)
+{
+    --m_stats.entries;
+    m_stats.bytes -= it->fragment->size();
+    m_index.erase(it->key);
+    m_entries.erase(it);
+}
+
+void fragment_cache::shrink()
+{
+    while(!m_entries.empty() && (m_stats.entries > m_max_entries || m_stats.bytes > m_max_bytes))
+    {
+        erase(std::prev(m_entries.end()));
+        ++m_stats.evictions;
+    }
+}
@@ -0,0 +1,310 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <cctype>
+#include <cstdio>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// helpers
+//
+
+/**
+ * @brief Quote @a text as a C++ string literal, one literal per line.
+ **/
+static std::string quote(const std::string & text, const std::string & indent)
+{
+    std::string result = "\"";
+    for(std::size_t ii = 0; ii < text.size(); ++ii)
+    {
+        unsigned char c = text[ii];
+        switch(c)
+        {
+        case '"':  result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\t': result += "\\t"; break;
+        case '\r': result += "\\r"; break;
+        case '\n':
+            result += "\\n\"";
+            if(ii + 1 < text.size())
+                result += "\n" + indent + "\"";
+            else
+                return result;
+            break;
+        default:
+            if(c < 0x20 || c >= 0x7f)
+            {
+                // octal escapes stop after 3 digits, unlike hexadecimal ones
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\%03o", c);
+                result += buffer;
+            }
+            else result += c;
+        }
+    }
+    return result + "\"";
+}
+
+/**
+ * @brief Emits the body of a render function.
+ **/
+class cpp_emitter
+{
+public:
+    cpp_emitter(const compiled_template & input): m_input(input) {}
+
+    /**
+     * @brief The statements rendering the template, in the scope "s0".
+     **/
+    std::string body()
+    {
+        std::ostringstream out;
+        emit_range(out, 0, m_input.size(), "s0", 1);
+        return out.str();
+    }
+
+    /**
+     * @brief The key paths, loop names and expressions used by the body.
+     **/
+    void emit_constants(std::ostream & out) const
+    {
+        out << "namespace {\n\n";
+        for(std::size_t ii = 0; ii < m_keys.size(); ++ii)
+        {
+            out << "const std::vector<std::string> key_" << ii << " = {";
+            for(std::size_t jj = 0; jj < m_keys[ii].size(); ++jj)
+            {
+                out << (jj ? ", " : "") << quote(m_keys[ii][jj], "");
+            }
+            out << "};\n";
+        }
+        for(std::size_t ii = 0; ii < m_names.size(); ++ii)
+        {
+            out << "const std::string name_" << ii << " = " << quote(m_names[ii], "") << ";\n";
+        }
+        for(std::size_t ii = 0; ii < m_expressions.size(); ++ii)
+        {
+            out << "const ez::temp::expression expr_" << ii << "(" << quote(m_expressions[ii], "") << ");\n";
+        }
+        out << "\n} // namespace\n\n";
+    }
+
+private:
+    std::string indent(int level) const
+    {
+        return std::string(level * 4, ' ');
+    }
+
+    std::string key(const std::vector<std::string> & keys)
+    {
+        m_keys.push_back(keys);
+        return "key_" + std::to_string(m_keys.size() - 1);
+    }
+
+    std::string expression(const ez::temp::expression & expr)
+    {
+        m_expressions.push_back(expr.source());
+        return "expr_" + std::to_string(m_expressions.size() - 1);
+    }
+
+    void emit_range(std::ostream & out, int begin, int end, const std::string & context, int level)
+    {
+        const std::string in = indent(level);
+        for(int ii = begin; ii < end; ++ii)
+        {
+            const token & tok = m_input[ii];
+            switch(tok.op())
+            {
+            case opcode::text:
+                out << in << "output.write(" << quote(std::string(tok.text().text()), in + "             ")
+                    << ", " << tok.text().text().size() << ");\n";
+                break;
+            case opcode::render:
+                {
+                    const render_token & render = tok.render();
+                    if(render.is_expression())
+                    {
+                        out << in << expression(render.expression()) << ".render(" << context << ", output);\n";
+                    }
+                    else if(render.is_function())
+                    {
+                        out << in << "{\n"
+                            << in << "    static const ez::temp::render_function & function = ez::temp::renderer::function("
+                            << quote(render.function(), "") << ");\n"
+                            << in << "    ez::temp::array args;\n";
+                        if(!render.arguments().empty())
+                            out << in << "    args.reserve(" << render.arguments().size() << ");\n";
+                        for(const std::vector<std::string> & arg: render.arguments())
+                        {
+                            out << in << "    args.push_back(ez::temp::renderer::value_at(" << context << ", " << key(arg) << "));\n";
+                        }
+                        out << in << "    output.write(function(args));\n"
+                            << in << "}\n";
+                    }
+                    else
+                    {
+                        out << in << "ez::temp::renderer::write_value(ez::temp::renderer::value_at(" << context << ", " << key(render.keys())
+                            << "), output);\n";
+                    }
+                }
+                break;
+            case opcode::for_loop:
+                {
+                    const section_token & section = tok.section();
+                    std::string id = std::to_string(++m_scopes);
+                    m_names.push_back(section.params()[1]);
+                    out << in << "{\n"
+                        << in << "    const ez::temp::array & array_" << id << " = ez::temp::renderer::loop_array("
+                        << context << ", " << key(section.loop_keys()) << ");\n"
+                        << in << "    ez::temp::scope s" << id << "(" << context << ", name_" << m_names.size() - 1
+                        << ", array_" << id << ".size());\n"
+                        << in << "    for(const ez::temp::node & value_" << id << ": array_" << id << ")\n"
+                        << in << "    {\n"
+                        << in << "        s" << id << ".next(value_" << id << ");\n";
+                    emit_range(out, ii + 1, tok.jump(), "s" + id, level + 2);
+                    out << in << "    }\n"
+                        << in << "}\n";
+                    ii = tok.jump();
+                }
+                break;
+            case opcode::cache:
+                {
+                    // the body writes to a fragment through a sink shadowing "output"
+                    const section_token & section = tok.section();
+                    std::string id = std::to_string(++m_scopes);
+                    char ttl[32];
+                    std::snprintf(ttl, sizeof(ttl), "%.17g", section.ttl());
+                    out << in << "{\n"
+                        << in << "    std::string key_value_" << id << ";\n"
+                        << in << "    ez::temp::string_sink key_sink_" << id << "(key_value_" << id << ");\n"
+                        << in << "    " << expression(section.key()) << ".render(" << context << ", key_sink_" << id << ");\n"
+                        << in << "    if(std::shared_ptr<const std::string> fragment_" << id
+                        << " = ez::temp::renderer::cache().find(key_value_" << id << "))\n"
+                        << in << "    {\n"
+                        << in << "        output.write(*fragment_" << id << ");\n"
+                        << in << "    }\n"
+                        << in << "    else\n"
+                        << in << "    {\n"
+                        << in << "        std::string rendered_" << id << ";\n"
+                        << in << "        {\n"
+                        << in << "            ez::temp::string_sink sink_" << id << "(rendered_" << id << ");\n"
+                        << in << "            ez::temp::output_sink & output = sink_" << id << ";\n";
+                    emit_range(out, ii + 1, tok.jump(), context, level + 3);
+                    out << in << "        }\n"
+                        << in << "        output.write(rendered_" << id << ");\n"
+                        << in << "        ez::temp::renderer::cache().insert(key_value_" << id << ", std::move(rendered_" << id
+                        << "), " << ttl << ");\n"
+                        << in << "    }\n"
+                        << in << "}\n";
+                    ii = tok.jump();
+                }
+                break;
+            case opcode::if_test:
+                {
+                    out << in << "if(" << expression(tok.section().condition()) << ".test(" << context << "))\n"
+                        << in << "{\n";
+                    int next = tok.jump();
+                    emit_range(out, ii + 1, next, context, level + 1);
+                    out << in << "}\n";
+                    if(m_input[next].op() == opcode::else_branch)
+                    {
+                        out << in << "else\n"
+                            << in << "{\n";
+                        emit_range(out, next + 1, m_input[next].jump(), context, level + 1);
+                        out << in << "}\n";
+                        next = m_input[next].jump();
+                    }
+                    ii = next;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    const compiled_template & m_input;
+    std::vector<std::vector<std::string>> m_keys;
+    std::vector<std::string> m_names;
+    std::vector<std::string> m_expressions;
+    int m_scopes = 0;
+};
+
+// --------------------------------------------
+// cpp_generator stuff
+//
+
+cpp_generator::cpp_generator(const std::string & function)
+{
+    boost::algorithm::split(m_namespaces, function, boost::algorithm::is_any_of(":"), boost::algorithm::token_compress_on);
+    m_function = m_namespaces.back();
+    m_namespaces.pop_back();
+    if(m_function.empty() || std::isdigit(static_cast<unsigned char>(m_function[0])))
+    {
+        std::stringstream ss;
+        ss << "ez::temp::cpp_generator: invalid function name: \"" << function << "\"";
+        throw std::invalid_argument(ss.str());
+    }
+}
+
+std::string cpp_generator::function_name(const std::string & filepath)
+{
+    std::string name = boost::filesystem::path(filepath).filename().string();
+    if(boost::algorithm::ends_with(name, ".ez"))
+        name.erase(name.size() - 3);
+    for(char & c: name)
+    {
+        if(!std::isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+    return "render_" + name;
+}
+
+void cpp_generator::generate(const compiled_template & input, const std::string & header_name,
+                             std::ostream & header, std::ostream & source) const
+{
+    std::string open_namespaces;
+    std::string close_namespaces;
+    for(const std::string & ns: m_namespaces)
+    {
+        open_namespaces += "namespace " + ns + " {\n";
+        close_namespaces = "} // namespace " + ns + "\n" + close_namespaces;
+    }
+
+    header << "// Generated by eztemp-cc, do not edit.\n"
+           << "#pragma once\n\n"
+           << "#include <eztemp.h>\n\n"
+           << open_namespaces << (open_namespaces.empty() ? "" : "\n")
+           << "void " << m_function << "(const ez::temp::dict & context, ez::temp::output_sink & output);\n\n"
+           << "std::string " << m_function << "(const ez::temp::dict & context);\n"
+           << (close_namespaces.empty() ? "" : "\n") << close_namespaces;
+
+    cpp_emitter emitter(input);
+    std::string body = emitter.body();
+
+    source << "// Generated by eztemp-cc, do not edit.\n"
+           << "#include \"" << header_name << "\"\n\n";
+    emitter.emit_constants(source);
+    source
+           << open_namespaces << (open_namespaces.empty() ? "" : "\n")
+           << "void " << m_function << "(const ez::temp::dict & context, ez::temp::output_sink & output)\n"
+           << "{\n"
+           << "    const ez::temp::scope s0(context);\n"
+           << body
+           << "    output.flush();\n"
+           << "}\n\n"
+           << "std::string " << m_function << "(const ez::temp::dict & context)\n"
+           << "{\n"
+           << "    std::string output;\n"
+           << "    ez::temp::string_sink sink(output);\n"
+           << "    " << m_function << "(context, sink);\n"
+           << "    return output;\n"
+           << "}\n"
+           << (close_namespaces.empty() ? "" : "\n") << close_namespaces;
+}
@@ -0,0 +1,715 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <ezexpr.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// .ezc format
+//
+// Native byte order, checked by a mark, every integer is unaligned:
+//
+//  "EZTC" | u32 version | u32 byte order mark
+//  string template | u32 count, { string path | u64 size | i64 mtime }
+//  u64 removed tokens
+//  u64 size, texts
+//  u32 count, { u8 type | payload }
+//
+// Strings are a u32 length and their bytes, texts an offset and a length
+// into the texts. Jumps are not stored, tokens are linked once loaded.
+//
+// .ezb bundles share the texts of their templates:
+//
+//  "EZTB" | u32 version | u32 byte order mark
+//  u64 size, texts
+//  u32 count, { string name | string base | u64 removed tokens | u32 count, { u8 type | payload } }
+//
+// The base is the name of the extended template, empty if none.
+//
+
+namespace {
+
+const char template_magic[4] = {'E', 'Z', 'T', 'C'};
+const char bundle_magic[4] = {'E', 'Z', 'T', 'B'};
+const std::uint32_t byte_order_mark = 0x01020304;
+
+renderer::compile_exception load_error(const std::string & path, const char * what)
+{
+    std::stringstream ss;
+    ss << "ez::temp::load: " << what << ": \"" << path << "\"";
+    return renderer::compile_exception(ss.str().c_str());
+}
+
+/**
+ * @brief Get the size and modification time of a file, false if it cannot be read.
+ **/
+bool file_stamp(const std::string & path, std::uint64_t & size, std::int64_t & mtime)
+{
+#ifdef _WIN32
+    boost::system::error_code ec;
+    size = boost::filesystem::file_size(path, ec);
+    if(ec)
+        return false;
+    mtime = boost::filesystem::last_write_time(path, ec);
+    return !ec;
+#else
+    // a single stat: staleness is checked on every load
+    struct stat status;
+    if(::stat(path.c_str(), &status) != 0)
+        return false;
+    size = status.st_size;
+    mtime = status.st_mtime;
+    return true;
+#endif
+}
+
+class binary_writer
+{
+public:
+    template<typename T>
+    void write(T value)
+    {
+        m_buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void write(std::string_view text)
+    {
+        write(static_cast<std::uint32_t>(text.size()));
+        m_buffer.append(text.data(), text.size());
+    }
+
+    void write(const std::vector<std::string> & list)
+    {
+        write(static_cast<std::uint32_t>(list.size()));
+        for(const std::string & item: list)
+            write(std::string_view(item));
+    }
+
+    void write(const std::vector<std::vector<std::string>> & lists)
+    {
+        write(static_cast<std::uint32_t>(lists.size()));
+        for(const std::vector<std::string> & list: lists)
+            write(list);
+    }
+
+    inline void append(std::string_view bytes) { m_buffer.append(bytes.data(), bytes.size()); }
+    inline const std::string & buffer() const { return m_buffer; }
+
+    void save(const std::string & path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(m_buffer.data(), m_buffer.size());
+        file.close();
+        if(!file)
+        {
+            std::stringstream ss;
+            ss << "ez::temp::save: cannot write: \"" << path << "\"";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+    }
+
+private:
+    std::string m_buffer;
+};
+
+/**
+ * @brief The texts of the saved tokens, each distinct text being stored once.
+ **/
+class text_pool
+{
+public:
+    std::uint64_t add(std::string_view text)
+    {
+        auto it = m_offsets.find(text);
+        if(it != m_offsets.end())
+            return it->second;
+        std::uint64_t offset = m_texts.size();
+        m_texts.append(text.data(), text.size());
+        m_offsets.emplace(text, offset);
+        return offset;
+    }
+
+    inline const std::string & texts() const { return m_texts; }
+
+private:
+    std::string m_texts;
+    std::unordered_map<std::string_view, std::uint64_t> m_offsets;    ///< views of the saved tokens
+};
+
+/**
+ * @brief Bounds checked reads of a mapped .ezc file.
+ **/
+class binary_reader
+{
+public:
+    binary_reader(std::string_view data, const std::string & path):
+        m_it(data.data()),
+        m_end(data.data() + data.size()),
+        m_path(path)
+    {}
+
+    template<typename T>
+    T read()
+    {
+        T value;
+        std::memcpy(&value, bytes(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    std::string_view read_view(std::size_t size)
+    {
+        return std::string_view(bytes(size), size);
+    }
+
+    std::string read_string()
+    {
+        return std::string(read_view(read<std::uint32_t>()));
+    }
+
+    std::vector<std::string> read_list()
+    {
+        std::vector<std::string> list(count(sizeof(std::uint32_t)));
+        for(std::string & item: list)
+            item = read_string();
+        return list;
+    }
+
+    std::vector<std::vector<std::string>> read_lists()
+    {
+        std::vector<std::vector<std::string>> lists(count(sizeof(std::uint32_t)));
+        for(std::vector<std::string> & list: lists)
+            list = read_list();
+        return lists;
+    }
+
+    /**
+     * @brief Read an element count, checking that the elements may follow.
+     **/
+    std::size_t count(std::size_t element_size)
+    {
+        std::uint32_t value = read<std::uint32_t>();
+        if(static_cast<std::size_t>(m_end - m_it) / element_size < value)
+            error("truncated file");
+        return value;
+    }
+
+    inline bool at_end() const { return m_it == m_end; }
+
+    [[noreturn]] void error(const char * what) const
+    {
+        throw load_error(m_path, what);
+    }
+
+private:
+    const char * bytes(std::size_t size)
+    {
+        if(static_cast<std::size_t>(m_end - m_it) < size)
+            error("truncated file");
+        const char * start = m_it;
+        m_it += size;
+        return start;
+    }
+
+    const char * m_it;
+    const char * m_end;
+    const std::string & m_path;
+};
+
+} // namespace
+
+namespace ez {
+
+namespace temp {
+
+/**
+ * @brief The template_serializer class
+ * Writes and reads the parsed tokens of a compiled_template.
+ **/
+class template_serializer
+{
+public:
+    /**
+     * @brief Write the tokens of @a prog, its texts going to @a texts.
+     **/
+    static void write(binary_writer & out, const compiled_template & prog, text_pool & texts)
+    {
+        out.write(static_cast<std::uint32_t>(prog.size()));
+        for(const token & tok: prog)
+            write(out, tok, texts);
+    }
+
+    /**
+     * @brief Read a template written by write(), its texts being views of @a texts held by @a source.
+     **/
+    static compiled_template read(binary_reader & in, std::string_view texts, std::shared_ptr<const template_source> source,
+                                  std::size_t removed)
+    {
+        token_list tokens;
+        const std::size_t count = in.count(1);
+        tokens.reserve(count);
+        while(tokens.size() < count)
+            tokens.push_back(read(in, texts));
+
+        source_list sources;
+        sources.push_back(std::move(source));
+        compiled_template prog(std::move(tokens), std::move(sources));
+        prog.m_removed = removed;
+        return prog;
+    }
+
+private:
+    static void write(binary_writer & out, const token & tok, text_pool & texts)
+    {
+        out.write(static_cast<std::uint8_t>(tok.token_type()));
+        switch(tok.token_type())
+        {
+        case token::type::text:
+            {
+                std::string_view text = tok.text().text();
+                out.write(texts.add(text));
+                out.write(static_cast<std::uint64_t>(text.size()));
+            }
+            break;
+        case token::type::render:
+            {
+                const render_token & render = tok.render();
+                out.write(std::string_view(render.m_content));
+                out.write(std::string_view(render.m_function));
+                out.write(render.m_keys);
+                out.write(render.m_arguments);
+                write(out, render.m_expression);
+            }
+            break;
+        case token::type::section:
+            {
+                const section_token & section = tok.section();
+                out.write(std::string_view(section.m_content));
+                out.write(section.m_params);
+                out.write(static_cast<std::uint8_t>(section.m_op));
+                out.write(static_cast<std::uint8_t>(section.m_parallel));
+                out.write(section.m_loop_keys);
+                out.write(section.m_ttl);
+                write(out, section.m_condition);
+                write(out, section.m_key);
+            }
+            break;
+        }
+    }
+
+    static token read(binary_reader & in, std::string_view texts)
+    {
+        switch(static_cast<token::type>(in.read<std::uint8_t>()))
+        {
+        case token::type::text:
+            {
+                std::uint64_t offset = in.read<std::uint64_t>();
+                std::uint64_t size = in.read<std::uint64_t>();
+                if(offset > texts.size() || size > texts.size() - offset)
+                    in.error("text out of bounds");
+                token tok(text_token(texts.substr(offset, size)));
+                // the texts are not in a template file
+                tok.m_position = nullptr;
+                return tok;
+            }
+        case token::type::render:
+            {
+                render_token render;
+                render.m_content = in.read_string();
+                render.m_function = in.read_string();
+                render.m_keys = in.read_list();
+                render.m_arguments = in.read_lists();
+                read(in, render.m_expression);
+                if(!render.m_function.empty())
+                {
+                    render.m_callable = renderer::functions().find(render.m_function);
+                    if(!render.m_callable)
+                        in.error(("unknown function " + render.m_function).c_str());
+                }
+                return token(std::move(render));
+            }
+        case token::type::section:
+            {
+                section_token section;
+                section.m_content = in.read_string();
+                section.m_params = in.read_list();
+                std::uint8_t op = in.read<std::uint8_t>();
+                if(op > static_cast<std::uint8_t>(opcode::unknown))
+                    in.error("invalid opcode");
+                section.m_op = static_cast<opcode>(op);
+                section.m_parallel = in.read<std::uint8_t>() != 0;
+                section.m_loop_keys = in.read_list();
+                section.m_ttl = in.read<double>();
+                read(in, section.m_condition);
+                read(in, section.m_key);
+                return token(std::move(section));
+            }
+        }
+        in.error("invalid token");
+    }
+
+    static void write(binary_writer & out, const std::optional<expression> & expr)
+    {
+        out.write(static_cast<std::uint8_t>(expr.has_value()));
+        if(!expr)
+            return;
+        const expression::program & prog = *expr->m_program;
+        out.write(std::string_view(prog.source));
+        out.write(static_cast<std::uint8_t>(prog.negate));
+        out.write(prog.path);
+        out.write(static_cast<std::uint32_t>(prog.tree.nodes.size()));
+        for(const ez::expr::ast::node & n: prog.tree.nodes)
+        {
+            out.write(static_cast<std::uint8_t>(n.kind));
+            out.write(static_cast<std::int32_t>(n.index));
+            out.write(static_cast<std::int32_t>(n.lhs));
+            out.write(static_cast<std::int32_t>(n.rhs));
+            out.write(n.value);
+        }
+        out.write(prog.tree.variables);
+        out.write(prog.tree.strings);
+        out.write(prog.keys);
+    }
+
+    static void read(binary_reader & in, std::optional<expression> & expr)
+    {
+        if(!in.read<std::uint8_t>())
+            return;
+        std::shared_ptr<expression::program> prog = std::make_shared<expression::program>();
+        prog->source = in.read_string();
+        prog->negate = in.read<std::uint8_t>() != 0;
+        prog->path = in.read_list();
+        prog->tree.nodes.resize(in.count(1 + 3 * sizeof(std::int32_t) + sizeof(double)));
+        for(ez::expr::ast::node & n: prog->tree.nodes)
+        {
+            std::uint8_t kind = in.read<std::uint8_t>();
+            if(kind > static_cast<std::uint8_t>(ez::expr::ast::op::logical_not))
+                in.error("invalid expression");
+            n.kind = static_cast<ez::expr::ast::op>(kind);
+            n.index = in.read<std::int32_t>();
+            n.lhs = in.read<std::int32_t>();
+            n.rhs = in.read<std::int32_t>();
+            n.value = in.read<double>();
+        }
+        prog->tree.variables = in.read_list();
+        prog->tree.strings = in.read_list();
+        prog->keys = in.read_lists();
+        check(in, *prog);
+        expr = expression(std::move(prog));
+    }
+
+    /**
+     * @brief Check the indexes of the expression nodes, so that a corrupted file cannot be evaluated.
+     **/
+    static void check(binary_reader & in, const expression::program & prog)
+    {
+        using op = ez::expr::ast::op;
+        const ez::expr::ast & tree = prog.tree;
+        if(prog.keys.size() != tree.variables.size())
+            in.error("invalid expression");
+        auto operand = [&](int operand, int index) {
+            // post-order: operands come first
+            if(operand < 0 || operand >= index)
+                in.error("invalid expression");
+        };
+        auto in_range = [&](int value, std::size_t size) {
+            if(value < 0 || static_cast<std::size_t>(value) >= size)
+                in.error("invalid expression");
+        };
+        for(int index = 0; index < static_cast<int>(tree.nodes.size()); ++index)
+        {
+            const ez::expr::ast::node & n = tree.nodes[index];
+            switch(n.kind)
+            {
+            case op::number:
+            case op::boolean:
+                break;
+            case op::constant:
+                in_range(n.index, ez::expr::ast::constant_names().size());
+                if(n.lhs != -1)
+                    in_range(n.lhs, tree.variables.size());
+                break;
+            case op::variable:
+                in_range(n.index, tree.variables.size());
+                break;
+            case op::string:
+                in_range(n.index, tree.strings.size());
+                break;
+            case op::negate:
+            case op::logical_not:
+                operand(n.lhs, index);
+                break;
+            case op::call1:
+                in_range(n.index, ez::expr::ast::unary_names().size());
+                operand(n.lhs, index);
+                break;
+            case op::call2:
+                in_range(n.index, ez::expr::ast::binary_names().size());
+                operand(n.lhs, index);
+                operand(n.rhs, index);
+                break;
+            default:
+                operand(n.lhs, index);
+                operand(n.rhs, index);
+                break;
+            }
+        }
+        if(prog.path.empty() && tree.nodes.empty())
+            in.error("invalid expression");
+    }
+};
+
+} // namespace temp
+
+} // namespace ez
+
+// --------------------------------------------
+// compiled_template stuff
+//
+
+void compiled_template::save(const std::string & path) const
+{
+    namespace fs = boost::filesystem;
+
+    binary_writer out;
+    out.append(std::string_view(template_magic, sizeof(template_magic)));
+    out.write(binary_version);
+    out.write(byte_order_mark);
+
+    // the template files, the first one being the template itself
+    std::vector<std::string> files;
+    for(const std::shared_ptr<const template_source> & source: m_sources)
+    {
+        if(!source->path().empty())
+            files.push_back(fs::absolute(source->path()).string());
+    }
+    out.write(std::string_view(!m_sources.empty() && !m_sources.front()->path().empty() ? files.front() : std::string()));
+    out.write(static_cast<std::uint32_t>(files.size()));
+    for(const std::string & file: files)
+    {
+        std::uint64_t size;
+        std::int64_t mtime;
+        if(!file_stamp(file, size, mtime))
+        {
+            std::stringstream ss;
+            ss << "ez::temp::save: cannot read template: \"" << file << "\"";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+        out.write(std::string_view(file));
+        out.write(size);
+        out.write(mtime);
+    }
+    out.write(static_cast<std::uint64_t>(m_removed));
+
+    // the texts come first, to be found when reading the tokens
+    binary_writer tokens;
+    text_pool texts;
+    template_serializer::write(tokens, *this, texts);
+    out.write(static_cast<std::uint64_t>(texts.texts().size()));
+    out.append(texts.texts());
+    out.append(tokens.buffer());
+    out.save(path);
+}
+
+compiled_template compiled_template::load(const std::string & path, bool check)
+{
+    // the texts are used in place: the file is a source of the template
+    std::shared_ptr<const template_source> binary = template_source::from_file(path);
+    binary_reader in(binary->text(), path);
+
+    if(in.read_view(sizeof(template_magic)) != std::string_view(template_magic, sizeof(template_magic)))
+        in.error("not a compiled template");
+    if(in.read<std::uint32_t>() != binary_version)
+        in.error("unsupported version");
+    if(in.read<std::uint32_t>() != byte_order_mark)
+        in.error("unsupported byte order");
+
+    const std::string source = in.read_string();
+    for(std::size_t count = in.count(sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t)); count; --count)
+    {
+        const std::string file = in.read_string();
+        std::uint64_t size = in.read<std::uint64_t>();
+        std::int64_t mtime = in.read<std::int64_t>();
+        if(!check)
+            continue;
+        std::uint64_t current_size;
+        std::int64_t current_mtime;
+        if(!file_stamp(file, current_size, current_mtime) || current_size != size || current_mtime != mtime)
+        {
+            std::stringstream ss;
+            ss << "ez::temp::load: \"" << path << "\" is older than \"" << file << "\"";
+            throw renderer::stale_exception(ss.str().c_str(), source);
+        }
+    }
+    std::uint64_t removed = in.read<std::uint64_t>();
+    std::string_view texts = in.read_view(in.read<std::uint64_t>());
+    compiled_template prog = template_serializer::read(in, texts, std::move(binary), removed);
+    if(!in.at_end())
+        in.error("unexpected trailing data");
+    return prog;
+}
+
+// --------------------------------------------
+// template_bundle stuff
+//
+
+template_bundle template_bundle::compile_directory(const std::string & directory)
+{
+    namespace fs = boost::filesystem;
+
+    boost::system::error_code ec;
+    if(!fs::is_directory(directory, ec))
+    {
+        std::stringstream ss;
+        ss << "ez::temp::template_bundle: not a directory: \"" << directory << "\"";
+        throw renderer::compile_exception(ss.str().c_str());
+    }
+    const fs::path root = fs::canonical(directory);
+
+    std::vector<std::string> files;
+    for(fs::recursive_directory_iterator it(root), end; it != end; ++it)
+    {
+        if(fs::is_regular_file(it->status()) && it->path().extension() == ".ez")
+            files.push_back(it->path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    auto name_of = [&root](const std::string & canonical_path) {
+        fs::path relative = fs::relative(canonical_path, root);
+        if(relative.empty() || *relative.begin() == "..")
+            return canonical_path;
+        return relative.generic_string();
+    };
+
+    // the environment compiles each layout once, for all the templates extending it
+    environment env({root.string()});
+    env.set_auto_reload(false);
+    template_bundle bundle;
+    for(const std::string & file: files)
+    {
+        const std::vector<std::string> chain = env.dependencies(file);
+        for(std::size_t index = 0; index < chain.size(); ++index)
+        {
+            entry & e = bundle.m_templates[name_of(chain[index])];
+            if(e.program)
+                break;  // so are its layouts
+            e.program = env.get_template(chain[index]);
+            if(index + 1 < chain.size())
+                e.base = name_of(chain[index + 1]);
+        }
+    }
+    return bundle;
+}
+
+void template_bundle::save(const std::string & path) const
+{
+    binary_writer out;
+    out.append(std::string_view(bundle_magic, sizeof(bundle_magic)));
+    out.write(compiled_template::binary_version);
+    out.write(byte_order_mark);
+
+    binary_writer templates;
+    text_pool texts;
+    templates.write(static_cast<std::uint32_t>(m_templates.size()));
+    for(const auto & named: m_templates)
+    {
+        templates.write(std::string_view(named.first));
+        templates.write(std::string_view(named.second.base));
+        templates.write(static_cast<std::uint64_t>(named.second.program->removed_tokens()));
+        template_serializer::write(templates, *named.second.program, texts);
+    }
+    out.write(static_cast<std::uint64_t>(texts.texts().size()));
+    out.append(texts.texts());
+    out.append(templates.buffer());
+    out.save(path);
+}
+
+template_bundle template_bundle::load(const std::string & path)
+{
+    // the texts are used in place: the file is a source of every template
+    std::shared_ptr<const template_source> binary = template_source::from_file(path);
+    binary_reader in(binary->text(), path);
+
+    if(in.read_view(sizeof(bundle_magic)) != std::string_view(bundle_magic, sizeof(bundle_magic)))
+        in.error("not a template bundle");
+    if(in.read<std::uint32_t>() != compiled_template::binary_version)
+        in.error("unsupported version");
+    if(in.read<std::uint32_t>() != byte_order_mark)
+        in.error("unsupported byte order");
+
+    std::string_view texts = in.read_view(in.read<std::uint64_t>());
+    template_bundle bundle;
+    for(std::size_t count = in.count(2 * sizeof(std::uint32_t) + sizeof(std::uint64_t) + sizeof(std::uint32_t)); count; --count)
+    {
+        const std::string name = in.read_string();
+        entry & e = bundle.m_templates[name];
+        if(e.program)
+            in.error("duplicate template");
+        e.base = in.read_string();
+        std::uint64_t removed = in.read<std::uint64_t>();
+        e.program = std::make_shared<const compiled_template>(template_serializer::read(in, texts, binary, removed));
+    }
+    if(!in.at_end())
+        in.error("unexpected trailing data");
+    return bundle;
+}
+
+const template_bundle::entry & template_bundle::at(const std::string & name) const
+{
+    auto it = m_templates.find(name);
+    if(it == m_templates.end())
+    {
+        std::stringstream ss;
+        ss << "ez::temp::template_bundle: template not found: \"" << name << "\"";
+        throw renderer::compile_exception(ss.str().c_str());
+    }
+    return it->second;
+}
+
+std::shared_ptr<const compiled_template> template_bundle::get_template(const std::string & name) const
+{
+    return at(name).program;
+}
+
+std::vector<std::string> template_bundle::names() const
+{
+    std::vector<std::string> result;
+    result.reserve(m_templates.size());
+    for(const auto & named: m_templates)
+        result.push_back(named.first);
+    return result;
+}
+
+std::vector<std::string> template_bundle::dependencies(const std::string & name) const
+{
+    std::vector<std::string> chain = {name};
+    for(const std::string * base = &at(name).base; !base->empty(); base = &at(*base).base)
+    {
+        // a loaded archive may be corrupted
+        if(chain.size() > m_templates.size())
+            throw renderer::compile_exception("ez::temp::template_bundle: extends cycle");
+        chain.push_back(*base);
+    }
+    return chain;
+}
+
+void template_bundle::render(const std::string & name, const dict & context, output_sink & output,
+                             const render_options & options) const
+{
+    renderer::render(*get_template(name), context, output, options);
+}
+
+std::string template_bundle::render(const std::string & name, const dict & context) const
+{
+    return renderer::render(*get_template(name), context);
+}
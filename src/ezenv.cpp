@@ -0,0 +1,143 @@
+#include <boost/filesystem.hpp>
+#include <sstream>
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+namespace fs = boost::filesystem;
+
+environment::environment(const std::vector<std::string> & search_path):
+    m_search_path(search_path),
+    m_auto_reload(true),
+    m_hits(0),
+    m_misses(0)
+{}
+
+void environment::add_search_path(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_search_path.push_back(path);
+}
+
+std::string environment::resolve(const std::string & name, const std::string & relative_to) const
+{
+    boost::system::error_code ec;
+    std::vector<fs::path> candidates;
+    if(!relative_to.empty())
+        candidates.push_back(fs::path(relative_to) / name);
+    else
+        candidates.push_back(fs::path(name));
+    for(const std::string & dir: m_search_path)
+        candidates.push_back(fs::path(dir) / name);
+
+    for(const fs::path & candidate: candidates)
+    {
+        if(fs::is_regular_file(candidate, ec))
+            return fs::canonical(candidate).string();
+    }
+
+    std::stringstream ss;
+    ss << "ez::temp::environment: template not found: \"" << name << "\"";
+    throw renderer::compile_exception(ss.str().c_str());
+}
+
+bool environment::is_fresh(const entry & e, const std::string & canonical_path)
+{
+    if(m_auto_reload)
+    {
+        boost::system::error_code ec;
+        std::time_t mtime = fs::last_write_time(canonical_path, ec);
+        if(ec || mtime != e.mtime)
+            return false;
+        std::uintmax_t size = fs::file_size(canonical_path, ec);
+        if(ec || size != e.size)
+            return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const environment::entry> environment::load(const std::string & canonical_path)
+{
+    auto it = m_cache.find(canonical_path);
+    if(it != m_cache.end() && is_fresh(*it->second, canonical_path))
+    {
+        // the extended layout may have been reloaded meanwhile
+        const std::shared_ptr<const entry> & base = it->second->base;
+        if(!base || load(it->second->base_path) == base)
+        {
+            ++m_hits;
+            return it->second;
+        }
+    }
+
+    ++m_misses;
+    std::shared_ptr<entry> e = std::make_shared<entry>();
+    e->mtime = fs::last_write_time(canonical_path);
+    e->size = fs::file_size(canonical_path);
+
+    e->sources.push_back(template_source::from_file(canonical_path));
+    token_list tokens = renderer::lex(e->sources.back()->text());
+
+    std::string extending_base = renderer::extends_base(tokens);
+    if(!extending_base.empty())
+    {
+        e->base_path = resolve(extending_base + ".ez", fs::path(canonical_path).parent_path().string());
+        e->base = load(e->base_path);
+        e->tokens = renderer::extend(e->base->tokens, tokens);
+        e->sources.insert(e->sources.end(), e->base->sources.begin(), e->base->sources.end());
+    }
+    else
+    {
+        e->tokens = std::move(tokens);
+    }
+    // the tokens stay as lexed to be extended, the program is optimized
+    auto program = std::make_shared<compiled_template>(e->tokens, e->sources);
+    program->optimize();
+    e->program = std::move(program);
+
+    m_cache[canonical_path] = e;
+    return e;
+}
+
+std::shared_ptr<const compiled_template> environment::get_template(const std::string & name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return load(resolve(name, std::string()))->program;
+}
+
+void environment::render(const std::string & name, const dict & context, output_sink & output,
+                         const render_options & options)
+{
+    renderer::render(*get_template(name), context, output, options);
+}
+
+std::string environment::render(const std::string & name, const dict & context)
+{
+    return renderer::render(*get_template(name), context);
+}
+
+std::vector<std::string> environment::dependencies(const std::string & name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string path = resolve(name, std::string());
+    std::vector<std::string> files = {path};
+    for(std::shared_ptr<const entry> e = load(path); e->base; e = e->base)
+    {
+        files.push_back(e->base_path);
+    }
+    return files;
+}
+
+void environment::invalidate(const std::string & name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.erase(resolve(name, std::string()));
+}
+
+void environment::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.clear();
+}
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+#include <ezexpr.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// evaluation
+//
+
+namespace {
+
+/**
+ * @brief Intermediate value of an expression, referring to the context
+ * nodes and the literals of the program instead of copying them.
+ **/
+struct value
+{
+    enum class kind { null, boolean, integer, real, string, other };
+
+    kind type = kind::null;
+    long long integer = 0;
+    double real = 0;
+    std::string_view text;
+    std::shared_ptr<const std::string> owned;   ///< the text of a concatenation
+    const node * origin = nullptr;  ///< the context node of a variable
+
+    static value of(const node & from)
+    {
+        value result;
+        result.origin = &from;
+        switch(from.kind())
+        {
+        case node::type::null: break;
+        case node::type::boolean: result.type = kind::boolean; result.integer = from.as_bool(); break;
+        case node::type::integer: result.type = kind::integer; result.integer = from.as_int(); break;
+        case node::type::real: result.type = kind::real; result.real = from.as_double(); break;
+        case node::type::string: result.type = kind::string; result.text = from.as_string(); break;
+        default: result.type = kind::other; break;
+        }
+        return result;
+    }
+    static value of_bool(bool from)
+    {
+        value result;
+        result.type = kind::boolean;
+        result.integer = from;
+        return result;
+    }
+    static value of_int(long long from)
+    {
+        value result;
+        result.type = kind::integer;
+        result.integer = from;
+        return result;
+    }
+    static value of_real(double from)
+    {
+        value result;
+        result.type = kind::real;
+        result.real = from;
+        return result;
+    }
+
+    inline bool is_number() const { return type == kind::integer || type == kind::real; }
+    inline double number() const { return type == kind::integer ? static_cast<double>(integer) : real; }
+
+    /**
+     * @brief Write the value the way {{ key }} does.
+     **/
+    void write(output_sink & output) const
+    {
+        if(origin)
+        {
+            renderer::write_value(*origin, output);
+            return;
+        }
+        switch(type)
+        {
+        case kind::integer:
+            {
+                char buffer[24];
+                int size = std::snprintf(buffer, sizeof(buffer), "%lld", integer);
+                output.write(buffer, size);
+            }
+            break;
+        case kind::real:    renderer::write_value(node(real), output); break;
+        case kind::boolean: renderer::write_value(node(integer != 0), output); break;
+        case kind::string:  output.write(text); break;
+        default:            renderer::write_value(node(), output); break;
+        }
+    }
+};
+
+class evaluator
+{
+public:
+    evaluator(const ez::expr::ast & tree, const std::vector<std::vector<std::string>> & keys,
+              const std::string & source, const scope & context):
+        m_tree(tree), m_keys(keys), m_source(source), m_context(context)
+    {
+    }
+
+    value evaluate(int index) const
+    {
+        using ez::expr::ast;
+        const ast::node & n = m_tree.nodes[index];
+        switch(n.kind)
+        {
+        case ast::op::number:
+            if(n.value == std::floor(n.value) && std::fabs(n.value) < 9e15)
+                return value::of_int(static_cast<long long>(n.value));
+            return value::of_real(n.value);
+        case ast::op::constant:
+            if(n.lhs >= 0)
+            {
+                // a value of the context named as the constant takes precedence
+                if(const node * bound = m_context.find(m_keys[n.lhs]))
+                    return value::of(*bound);
+            }
+            return value::of_real(ez::expr::constant<double>(n.index));
+        case ast::op::boolean:  return value::of_bool(n.value != 0);
+        case ast::op::string:
+            {
+                value result;
+                result.type = value::kind::string;
+                result.text = m_tree.strings[n.index];
+                return result;
+            }
+        case ast::op::variable:
+            try
+            {
+                return value::of(m_context.at(m_keys[n.index]));
+            }
+            catch(const std::out_of_range &)
+            {
+                throw error("variable not found: \"" + m_tree.variables[n.index] + "\"");
+            }
+            catch(const bad_node_access & e)
+            {
+                throw error("\"" + m_tree.variables[n.index] + "\": " + e.what());
+            }
+        case ast::op::negate:
+            {
+                value operand = evaluate(n.lhs);
+                if(operand.type == value::kind::integer)
+                    return value::of_int(-operand.integer);
+                return value::of_real(-number(operand));
+            }
+        case ast::op::add:
+        case ast::op::subtract:
+        case ast::op::multiply:
+            return arithmetic(n.kind, evaluate(n.lhs), evaluate(n.rhs));
+        case ast::op::divide:   return value::of_real(number(evaluate(n.lhs)) / number(evaluate(n.rhs)));
+        case ast::op::power:    return value::of_real(std::pow(number(evaluate(n.lhs)), number(evaluate(n.rhs))));
+        case ast::op::call1:    return value::of_real(ez::expr::unary<double>(n.index)(number(evaluate(n.lhs))));
+        case ast::op::call2:
+            return value::of_real(ez::expr::binary<double>(n.index)(number(evaluate(n.lhs)), number(evaluate(n.rhs))));
+        case ast::op::equal:         return value::of_bool(equal(evaluate(n.lhs), evaluate(n.rhs)));
+        case ast::op::not_equal:     return value::of_bool(!equal(evaluate(n.lhs), evaluate(n.rhs)));
+        case ast::op::less:          return value::of_bool(compare(evaluate(n.lhs), evaluate(n.rhs)) < 0);
+        case ast::op::less_equal:    return value::of_bool(compare(evaluate(n.lhs), evaluate(n.rhs)) <= 0);
+        case ast::op::greater:       return value::of_bool(compare(evaluate(n.lhs), evaluate(n.rhs)) > 0);
+        case ast::op::greater_equal: return value::of_bool(compare(evaluate(n.lhs), evaluate(n.rhs)) >= 0);
+        case ast::op::logical_and:   return value::of_bool(test(n.lhs) && test(n.rhs));
+        case ast::op::logical_or:    return value::of_bool(test(n.lhs) || test(n.rhs));
+        case ast::op::logical_not:   return value::of_bool(!test(n.lhs));
+        }
+        return value();
+    }
+
+    bool test(int index) const
+    {
+        value result = evaluate(index);
+        if(result.origin)
+            return renderer::test_value(*result.origin);
+        switch(result.type)
+        {
+        case value::kind::boolean:
+        case value::kind::integer: return result.integer != 0;
+        case value::kind::real:    return result.real != 0;
+        case value::kind::string:  return renderer::test_string(result.text);
+        default:                   return false;
+        }
+    }
+
+    renderer::render_exception error(const std::string & what) const
+    {
+        std::stringstream ss;
+        ss << "ez::temp::render: " << what << " in \"" << m_source << "\"";
+        return renderer::render_exception(ss.str().c_str());
+    }
+
+private:
+    double number(const value & operand) const
+    {
+        if(!operand.is_number())
+            throw error("not a number");
+        return operand.number();
+    }
+
+    value arithmetic(ez::expr::ast::op kind, const value & lhs, const value & rhs) const
+    {
+        using ez::expr::ast;
+        if(kind == ast::op::add && (lhs.type == value::kind::string || rhs.type == value::kind::string)
+           && (lhs.type == value::kind::string || lhs.is_number()) && (rhs.type == value::kind::string || rhs.is_number()))
+        {
+            // concatenation, numbers written as {{ }} does
+            auto text = std::make_shared<std::string>();
+            string_sink sink(*text);
+            lhs.write(sink);
+            rhs.write(sink);
+            value result;
+            result.type = value::kind::string;
+            result.text = *text;
+            result.owned = std::move(text);
+            return result;
+        }
+        if(lhs.type == value::kind::integer && rhs.type == value::kind::integer)
+        {
+            switch(kind)
+            {
+            case ast::op::add:      return value::of_int(lhs.integer + rhs.integer);
+            case ast::op::subtract: return value::of_int(lhs.integer - rhs.integer);
+            default:                return value::of_int(lhs.integer * rhs.integer);
+            }
+        }
+        double a = number(lhs);
+        double b = number(rhs);
+        switch(kind)
+        {
+        case ast::op::add:      return value::of_real(a + b);
+        case ast::op::subtract: return value::of_real(a - b);
+        default:                return value::of_real(a * b);
+        }
+    }
+
+    bool equal(const value & lhs, const value & rhs) const
+    {
+        if(lhs.is_number() && rhs.is_number())
+        {
+            if(lhs.type == value::kind::integer && rhs.type == value::kind::integer)
+                return lhs.integer == rhs.integer;
+            return lhs.number() == rhs.number();
+        }
+        if(lhs.type != rhs.type)
+            return false;
+        switch(lhs.type)
+        {
+        case value::kind::null:    return true;
+        case value::kind::boolean: return lhs.integer == rhs.integer;
+        case value::kind::string:  return lhs.text == rhs.text;
+        default:                   throw error("cannot compare arrays or objects");
+        }
+    }
+
+    int compare(const value & lhs, const value & rhs) const
+    {
+        if(lhs.is_number() && rhs.is_number())
+        {
+            if(lhs.type == value::kind::integer && rhs.type == value::kind::integer)
+                return lhs.integer < rhs.integer ? -1 : lhs.integer > rhs.integer;
+            double a = lhs.number();
+            double b = rhs.number();
+            return a < b ? -1 : a > b;
+        }
+        if(lhs.type == value::kind::string && rhs.type == value::kind::string)
+        {
+            int result = lhs.text.compare(rhs.text);
+            return result < 0 ? -1 : result > 0;
+        }
+        throw error("can only order numbers or strings");
+    }
+
+    const ez::expr::ast & m_tree;
+    const std::vector<std::vector<std::string>> & m_keys;
+    const std::string & m_source;
+    const scope & m_context;
+};
+
+} // namespace
+
+// --------------------------------------------
+// expression stuff
+//
+
+/**
+ * @brief @a text without its leading and trailing blanks.
+ **/
+static std::string_view trim(std::string_view text)
+{
+    std::size_t begin = text.find_first_not_of(" \t\r\n");
+    if(begin == std::string_view::npos)
+        return std::string_view();
+    return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+static bool is_key_path(std::string_view path)
+{
+    if(path.empty() || std::isdigit(static_cast<unsigned char>(path[0])) || path[0] == '-' || path[0] == '.')
+        return false;
+    // literals and constants are left to the parser
+    if(path == "true" || path == "false")
+        return false;
+    for(const std::string & name: ez::expr::ast::constant_names())
+    {
+        if(boost::algorithm::iequals(name, path))
+            return false;
+    }
+    return std::all_of(path.begin(), path.end(), [](char c){
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.' || static_cast<unsigned char>(c) >= 0x80;
+    });
+}
+
+bool expression::is_key_path(const std::string & source)
+{
+    return ::is_key_path(trim(source));
+}
+
+expression::expression(const std::string & source)
+{
+    auto prog = std::make_shared<program>();
+    prog->source = trim(source);
+    const std::string & text = prog->source;
+
+    // key paths may not be valid variables of the parser ("a-b"), "[not] key.path" is not parsed
+    std::size_t start = 0;
+    if(text.compare(0, 3, "not") == 0 && text.size() > 3 && (text[3] == ' ' || text[3] == '\t'))
+    {
+        start = text.find_first_not_of(" \t", 3);
+        prog->negate = true;
+    }
+    std::string_view path = std::string_view(text).substr(start);
+    if(::is_key_path(path) && path.find("..") == std::string_view::npos && path.back() != '.')
+    {
+        for(std::size_t dot; (dot = path.find('.')) != std::string_view::npos; path.remove_prefix(dot + 1))
+            prog->path.emplace_back(path.substr(0, dot));
+        prog->path.emplace_back(path);
+    }
+    else
+    {
+        prog->negate = false;
+        try
+        {
+            prog->tree = ez::expr::parser(text, true).parse();
+        }
+        catch(const ez::expr::parse_error & e)
+        {
+            std::stringstream ss;
+            ss << "ez::temp::compile: invalid expression: \"" << text << "\" (" << e.what() << ")";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+        for(const std::string & variable: prog->tree.variables)
+        {
+            prog->keys.push_back(split(variable, '.'));
+        }
+    }
+    m_program = std::move(prog);
+}
+
+const std::string & expression::source() const
+{
+    return m_program->source;
+}
+
+bool expression::is_constant() const
+{
+    return m_program->path.empty() && m_program->tree.variables.empty();
+}
+
+void expression::render(const scope & context, output_sink & output) const
+{
+    if(!m_program->path.empty())
+    {
+        if(m_program->negate)
+            renderer::write_value(node(test(context)), output);
+        else
+            renderer::write_value(renderer::value_at(context, m_program->path), output);
+        return;
+    }
+    evaluator eval(m_program->tree, m_program->keys, m_program->source, context);
+    eval.evaluate(static_cast<int>(m_program->tree.nodes.size()) - 1).write(output);
+}
+
+bool expression::test(const scope & context) const
+{
+    if(!m_program->path.empty())
+        return renderer::test_value(renderer::value_at(context, m_program->path)) != m_program->negate;
+    evaluator eval(m_program->tree, m_program->keys, m_program->source, context);
+    return eval.test(static_cast<int>(m_program->tree.nodes.size()) - 1);
+}
@@ -0,0 +1,375 @@
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+/**
+ * @brief The json_parser class
+ * Single pass recursive descent Json parser, building typed nodes in place:
+ * integers fitting an int become int, other numbers double, and true, false
+ * and null become bool and nullptr. Objects and arrays nest up to max_depth
+ * levels, the root object included, so that the stack stays bounded.
+ **/
+class json_parser
+{
+public:
+    static constexpr int max_depth = 512;
+
+    json_parser(const std::string & json):
+        m_begin(json.data()),
+        m_it(json.data()),
+        m_end(json.data() + json.size()),
+        m_depth(0)
+    {}
+
+    void parse(dict & context)
+    {
+        skip_whitespaces();
+        expect('{');
+        enter();
+        parse_members(context);
+        skip_whitespaces();
+        if(m_it != m_end)
+            error("unexpected trailing characters");
+    }
+
+private:
+
+    void parse_value(node & value)
+    {
+        skip_whitespaces();
+        if(m_it == m_end)
+            error("unexpected end of input");
+        switch(*m_it)
+        {
+        case '{':
+            {
+                ++m_it;
+                enter();
+                value = object();
+                parse_members(value.as_object());
+                --m_depth;
+            }
+            break;
+        case '[':
+            {
+                ++m_it;
+                enter();
+                value = array();
+                parse_elements(value.as_array());
+                --m_depth;
+            }
+            break;
+        case '"':
+            {
+                // the node copies the text, the buffer is reused
+                parse_string(m_string);
+                value = std::string_view(m_string);
+            }
+            break;
+        case 't':
+            expect_literal("true");
+            value = true;
+            break;
+        case 'f':
+            expect_literal("false");
+            value = false;
+            break;
+        case 'n':
+            expect_literal("null");
+            value = nullptr;
+            break;
+        default:
+            parse_number(value);
+        }
+    }
+
+    inline void enter()
+    {
+        if(++m_depth > max_depth)
+            error("too deeply nested");
+    }
+
+    template <typename Object>
+    void parse_members(Object & members)
+    {
+        skip_whitespaces();
+        if(consume('}'))
+            return;
+        std::string key;
+        do
+        {
+            skip_whitespaces();
+            parse_string(key);
+            skip_whitespaces();
+            expect(':');
+            node & value = members[key];
+            parse_value(value);
+            skip_whitespaces();
+        }
+        while(consume(','));
+        expect('}');
+    }
+
+    void parse_elements(array & elements)
+    {
+        skip_whitespaces();
+        if(consume(']'))
+            return;
+        do
+        {
+            elements.emplace_back();
+            parse_value(elements.back());
+            skip_whitespaces();
+        }
+        while(consume(','));
+        expect(']');
+    }
+
+    void parse_string(std::string & str)
+    {
+        expect('"');
+        str.clear();
+        const char * start = m_it;
+        for(;;)
+        {
+            if(m_it == m_end)
+                error("unterminated string");
+            char c = *m_it;
+            if(c == '"')
+            {
+                str.append(start, m_it);
+                ++m_it;
+                return;
+            }
+            else if(c == '\\')
+            {
+                str.append(start, m_it);
+                ++m_it;
+                parse_escape(str);
+                start = m_it;
+            }
+            else if(static_cast<unsigned char>(c) < 0x20)
+            {
+                error("control character in string");
+            }
+            else ++m_it;
+        }
+    }
+
+    void parse_escape(std::string & str)
+    {
+        if(m_it == m_end)
+            error("unterminated string");
+        switch(*m_it++)
+        {
+        case '"': str += '"'; break;
+        case '\\': str += '\\'; break;
+        case '/': str += '/'; break;
+        case 'b': str += '\b'; break;
+        case 'f': str += '\f'; break;
+        case 'n': str += '\n'; break;
+        case 'r': str += '\r'; break;
+        case 't': str += '\t'; break;
+        case 'u':
+            {
+                unsigned long code = parse_hex4();
+                if(code >= 0xD800 && code <= 0xDBFF)
+                {
+                    // surrogate pair
+                    if(m_end - m_it < 2 || m_it[0] != '\\' || m_it[1] != 'u')
+                        error("invalid unicode surrogate pair");
+                    m_it += 2;
+                    unsigned long low = parse_hex4();
+                    if(low < 0xDC00 || low > 0xDFFF)
+                        error("invalid unicode surrogate pair");
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(str, code);
+            }
+            break;
+        default:
+            --m_it;
+            error("invalid escape sequence");
+        }
+    }
+
+    unsigned long parse_hex4()
+    {
+        if(m_end - m_it < 4)
+            error("invalid unicode escape");
+        unsigned long code = 0;
+        for(int ii = 0; ii < 4; ++ii, ++m_it)
+        {
+            char c = *m_it;
+            code <<= 4;
+            if(c >= '0' && c <= '9')
+                code |= c - '0';
+            else if(c >= 'a' && c <= 'f')
+                code |= c - 'a' + 10;
+            else if(c >= 'A' && c <= 'F')
+                code |= c - 'A' + 10;
+            else error("invalid unicode escape");
+        }
+        return code;
+    }
+
+    static void append_utf8(std::string & str, unsigned long code)
+    {
+        if(code < 0x80)
+        {
+            str += static_cast<char>(code);
+        }
+        else if(code < 0x800)
+        {
+            str += static_cast<char>(0xC0 | (code >> 6));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if(code < 0x10000)
+        {
+            str += static_cast<char>(0xE0 | (code >> 12));
+            str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            str += static_cast<char>(0xF0 | (code >> 18));
+            str += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    void parse_number(node & value)
+    {
+        const char * start = m_it;
+        bool integral = true;
+        consume('-');
+        const char * digits = m_it;
+        if(!skip_digits())
+            error("invalid value");
+        if(*digits == '0' && m_it - digits > 1)
+        {
+            m_it = digits;
+            error("leading zero in number");
+        }
+        if(consume('.'))
+        {
+            integral = false;
+            if(!skip_digits())
+                error("invalid number");
+        }
+        if(m_it != m_end && (*m_it == 'e' || *m_it == 'E'))
+        {
+            integral = false;
+            ++m_it;
+            if(!consume('+'))
+                consume('-');
+            if(!skip_digits())
+                error("invalid number");
+        }
+
+        // numbers are always followed by a delimiter in a valid document,
+        // so that strtol/strtod stop at the same place.
+        if(integral && m_it - start < 12)
+        {
+            long long integer = std::strtoll(start, nullptr, 10);
+            if(integer >= INT_MIN && integer <= INT_MAX)
+            {
+                value = static_cast<int>(integer);
+                return;
+            }
+        }
+        value = std::strtod(start, nullptr);
+    }
+
+    bool skip_digits()
+    {
+        const char * start = m_it;
+        while(m_it != m_end && *m_it >= '0' && *m_it <= '9')
+            ++m_it;
+        return m_it != start;
+    }
+
+    inline void skip_whitespaces()
+    {
+        while(m_it != m_end && (*m_it == ' ' || *m_it == '\n' || *m_it == '\r' || *m_it == '\t'))
+            ++m_it;
+    }
+
+    inline bool consume(char c)
+    {
+        if(m_it != m_end && *m_it == c)
+        {
+            ++m_it;
+            return true;
+        }
+        return false;
+    }
+
+    inline void expect(char c)
+    {
+        if(!consume(c))
+        {
+            std::string what = "expected '";
+            what += c;
+            what += "'";
+            error(what.c_str());
+        }
+    }
+
+    void expect_literal(const char * literal)
+    {
+        std::size_t size = std::strlen(literal);
+        if(static_cast<std::size_t>(m_end - m_it) < size || std::strncmp(m_it, literal, size) != 0)
+            error("invalid value");
+        m_it += size;
+    }
+
+    void error(const char * what) const
+    {
+        int line = 1;
+        int column = 1;
+        for(const char * it = m_begin; it < m_it; ++it)
+        {
+            if(*it == '\n')
+            {
+                ++line;
+                column = 1;
+            }
+            else ++column;
+        }
+        std::stringstream ss;
+        ss << "ez::temp::dict::from_json: " << what << " (line " << line << ", column " << column << ")";
+        throw std::runtime_error(ss.str());
+    }
+
+    const char * m_begin;
+    const char * m_it;
+    const char * m_end;
+    int m_depth;            ///< objects and arrays being parsed
+    std::string m_string;   ///< string values being parsed
+};
+
+// --------------------------------------------
+// dict stuff
+//
+
+dict dict::from_json(const std::string &json)
+{
+    dict context;
+    json_parser(json).parse(context);
+    return context;
+}
+
+dict dict::from_json(const std::string & json, std::pmr::memory_resource * memory)
+{
+    memory_scope scope(memory);
+    return from_json(json);
+}
@@ -0,0 +1,237 @@
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EZ_TEMP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EZ_TEMP_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define EZ_TEMP_SSE2
+#endif
+
+#if defined(EZ_TEMP_X86) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define EZ_TEMP_AVX2
+#ifdef _MSC_VER
+#define EZ_TEMP_TARGET_AVX2
+#else
+#define EZ_TEMP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// delimiter scanning
+//
+
+/**
+ * Each scanner returns the first position p in [begin, end - 1) such that
+ * p[0] == first and p[1] is either second_a or second_b, or end if there is
+ * none. They never read at or past end.
+ **/
+using scan_function = const char * (*)(const char * begin, const char * end, char first, char second_a, char second_b);
+
+static const char * scan_scalar(const char * begin, const char * end, char first, char second_a, char second_b)
+{
+    if(end - begin < 2)
+        return end;
+    const char * last = end - 1;
+    const char * p = begin;
+    while((p = static_cast<const char *>(std::memchr(p, first, last - p))))
+    {
+        if(p[1] == second_a || p[1] == second_b)
+            return p;
+        ++p;
+    }
+    return end;
+}
+
+#if defined(EZ_TEMP_SSE2) || defined(EZ_TEMP_AVX2)
+static inline int count_trailing_zeros(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+#ifdef EZ_TEMP_SSE2
+static const char * scan_sse2(const char * begin, const char * end, char first, char second_a, char second_b)
+{
+    const __m128i f = _mm_set1_epi8(first);
+    const __m128i a = _mm_set1_epi8(second_a);
+    const __m128i b = _mm_set1_epi8(second_b);
+    const char * p = begin;
+    // the second load reads p[1..16]
+    for(; end - p > 16; p += 16)
+    {
+        __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        __m128i match = _mm_and_si128(_mm_cmpeq_epi8(c0, f),
+                                      _mm_or_si128(_mm_cmpeq_epi8(c1, a), _mm_cmpeq_epi8(c1, b)));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(match));
+        if(mask)
+            return p + count_trailing_zeros(mask);
+    }
+    return scan_scalar(p, end, first, second_a, second_b);
+}
+#endif
+
+#ifdef EZ_TEMP_AVX2
+EZ_TEMP_TARGET_AVX2
+static const char * scan_avx2(const char * begin, const char * end, char first, char second_a, char second_b)
+{
+    const __m256i f = _mm256_set1_epi8(first);
+    const __m256i a = _mm256_set1_epi8(second_a);
+    const __m256i b = _mm256_set1_epi8(second_b);
+    const char * p = begin;
+    // the second load reads p[1..32]
+    for(; end - p > 32; p += 32)
+    {
+        __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(c0, f),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(c1, a), _mm256_cmpeq_epi8(c1, b)));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(match));
+        if(mask)
+            return p + count_trailing_zeros(mask);
+    }
+    return scan_scalar(p, end, first, second_a, second_b);
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // the OS must save the AVX registers (OSXSAVE, then XCR0 bits 1 and 2)
+    if(!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    // may run before the libgcc constructors, from the static initializers below
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static scan_function scanner(lexer_isa isa)
+{
+    switch(isa)
+    {
+#ifdef EZ_TEMP_AVX2
+    case lexer_isa::avx2:
+        return cpu_has_avx2() ? scan_avx2 : nullptr;
+#endif
+#ifdef EZ_TEMP_SSE2
+    case lexer_isa::sse2:
+        return scan_sse2;
+#endif
+    case lexer_isa::scalar:
+        return scan_scalar;
+    default:
+        return nullptr;
+    }
+}
+
+static lexer_isa best_lexer_isa()
+{
+    for(lexer_isa isa: {lexer_isa::avx2, lexer_isa::sse2})
+    {
+        if(scanner(isa))
+            return isa;
+    }
+    return lexer_isa::scalar;
+}
+
+static std::atomic<lexer_isa> current_isa(best_lexer_isa());
+static std::atomic<scan_function> current_scanner(scanner(current_isa));
+
+// --------------------------------------------
+// lexer stuff
+//
+
+bool renderer::set_lexer_isa(lexer_isa isa)
+{
+    scan_function scan = scanner(isa);
+    if(!scan)
+        return false;
+    current_isa = isa;
+    current_scanner = scan;
+    return true;
+}
+
+lexer_isa renderer::current_lexer_isa()
+{
+    return current_isa;
+}
+
+token_list renderer::lex(std::string_view input)
+{
+    token_list tokens;
+    const scan_function scan = current_scanner;
+
+    const char * const begin = input.data();
+    const char * const end = begin + input.size();
+
+    auto push_text_if_required = [&tokens](const char * from, const char * to){
+        if(from != to)
+        {
+            tokens.emplace_back(text_token(std::string_view(from, to - from)));
+        }
+    };
+
+    const char * last = begin;
+    const char * it = begin;
+    // jump from one "{{" or "{%" to the next
+    while((it = scan(it, end, '{', '{', '%')) != end)
+    {
+        bool is_render = it[1] == '{';
+        const char * close = is_render ? scan(it + 2, end, '}', '}', '}') : scan(it + 2, end, '%', '}', '}');
+        if(close == end)
+        {
+            // unterminated tag: the rest is text
+            break;
+        }
+        const char * tag_end = close + 2;
+
+        if(is_render)
+        {
+            push_text_if_required(last, it);
+            tokens.emplace_back(render_token(std::string(it, tag_end)), it);
+        }
+        else
+        {
+            // a section alone on its line takes the line break and indentation before it
+            const char * text_end = it;
+            while(text_end > last && (text_end[-1] == ' ' || text_end[-1] == '\t'))
+                --text_end;
+            if(text_end > last && text_end[-1] == '\n')
+                --text_end;
+            else
+                text_end = it;
+            push_text_if_required(last, text_end);
+            tokens.emplace_back(section_token(std::string(it, tag_end)), it);
+        }
+        last = it = tag_end;
+    }
+    push_text_if_required(last, end);
+
+    return tokens;
+}
@@ -0,0 +1,259 @@
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// memory stuff
+//
+
+static thread_local std::pmr::memory_resource * current_resource = nullptr;
+
+memory_scope::memory_scope(std::pmr::memory_resource * resource):
+    m_previous(current_resource)
+{
+    current_resource = resource;
+}
+
+memory_scope::~memory_scope()
+{
+    current_resource = m_previous;
+}
+
+std::pmr::memory_resource * memory_scope::current()
+{
+    return current_resource;
+}
+
+// the blocks of a resource start with it, the data after this header is
+// misaligned on block_alignment: the blocks of the global operator new,
+// aligned on it, need no header
+static constexpr std::size_t block_alignment = 2 * memory_scope::alignment;
+static_assert(sizeof(std::pmr::memory_resource *) <= memory_scope::alignment, "resource header");
+static_assert((memory_scope::alignment & (memory_scope::alignment - 1)) == 0, "power of two alignment");
+
+void * memory_scope::allocate(std::size_t bytes)
+{
+    std::pmr::memory_resource * resource = current_resource;
+    if(!resource)
+        return ::operator new(bytes, std::align_val_t(block_alignment));
+    void * block = resource->allocate(bytes + alignment, block_alignment);
+    *static_cast<std::pmr::memory_resource **>(block) = resource;
+    return static_cast<char *>(block) + alignment;
+}
+
+void memory_scope::deallocate(void * data, std::size_t bytes) noexcept
+{
+    if(!(reinterpret_cast<std::uintptr_t>(data) & alignment))
+    {
+        ::operator delete(data, std::align_val_t(block_alignment));
+        return;
+    }
+    void * block = static_cast<char *>(data) - alignment;
+    std::pmr::memory_resource * resource = *static_cast<std::pmr::memory_resource **>(block);
+    resource->deallocate(block, bytes + alignment, block_alignment);
+}
+
+/**
+ * @brief A new object, allocated through memory_scope.
+ **/
+template <typename... Args>
+static ez::temp::object * new_object(Args &&... args)
+{
+    void * data = memory_scope::allocate(sizeof(ez::temp::object));
+    try
+    {
+        return new (data) ez::temp::object(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+        memory_scope::deallocate(data, sizeof(ez::temp::object));
+        throw;
+    }
+}
+
+static void delete_object(ez::temp::object * value) noexcept
+{
+    value->~object();
+    memory_scope::deallocate(value, sizeof(ez::temp::object));
+}
+
+// --------------------------------------------
+// node stuff
+//
+
+static const char * type_names[] = {
+    "null", "string", "int", "double", "bool", "array", "object",
+};
+
+node::node(std::string_view value):
+    m_type(type::string)
+{
+    if(value.size() <= small_capacity)
+    {
+        std::memcpy(m_small.data, value.data(), value.size());
+        m_small.size = static_cast<std::uint8_t>(value.size());
+    }
+    else
+    {
+        m_large.data = static_cast<char *>(memory_scope::allocate(value.size()));
+        m_large.size = value.size();
+        std::memcpy(m_large.data, value.data(), value.size());
+        m_small.size = large_marker;
+    }
+}
+
+node::node(const ez::temp::object & value):
+    m_object(new_object(value)),
+    m_type(type::object)
+{
+}
+
+node::node(ez::temp::object && value):
+    m_object(new_object(std::move(value))),
+    m_type(type::object)
+{
+}
+
+node::node(const node & other):
+    m_type(type::null)
+{
+    copy_from(other);
+}
+
+node::node(node && other) noexcept:
+    m_type(type::null)
+{
+    move_from(other);
+}
+
+node & node::operator=(const node & other)
+{
+    if(this != &other)
+    {
+        node copy(other);
+        destroy();
+        move_from(copy);
+    }
+    return *this;
+}
+
+node & node::operator=(node && other) noexcept
+{
+    if(this != &other)
+    {
+        // other may be held by this node (n = std::move(n.as_array()[0]))
+        node moved(std::move(other));
+        destroy();
+        move_from(moved);
+    }
+    return *this;
+}
+
+const char * node::type_name() const
+{
+    return type_names[static_cast<int>(m_type)];
+}
+
+void node::bad_access(node::type expected) const
+{
+    std::string what = "ez::temp::node: bad access: ";
+    what += type_names[static_cast<int>(expected)];
+    what += " requested, ";
+    what += type_name();
+    what += " held";
+    throw bad_node_access(what.c_str());
+}
+
+void node::copy_from(const node & other)
+{
+    switch(other.m_type)
+    {
+    case type::string:
+        if(other.is_small())
+        {
+            m_small = other.m_small;
+        }
+        else
+        {
+            m_large.data = static_cast<char *>(memory_scope::allocate(other.m_large.size));
+            m_large.size = other.m_large.size;
+            std::memcpy(m_large.data, other.m_large.data, other.m_large.size);
+            m_small.size = large_marker;
+        }
+        break;
+    case type::array:
+        new (&m_array) ez::temp::array(other.m_array);
+        break;
+    case type::object:
+        m_object = new_object(*other.m_object);
+        break;
+    case type::integer:
+        m_int = other.m_int;
+        break;
+    case type::real:
+        m_double = other.m_double;
+        break;
+    case type::boolean:
+        m_bool = other.m_bool;
+        break;
+    default:
+        break;
+    }
+    m_type = other.m_type;
+}
+
+void node::move_from(node & other) noexcept
+{
+    switch(other.m_type)
+    {
+    case type::string:
+        // small or large, the raw bytes are the value
+        std::memcpy(static_cast<void *>(&m_small), &other.m_small, sizeof(m_small));
+        break;
+    case type::array:
+        new (&m_array) ez::temp::array(std::move(other.m_array));
+        other.m_array.~array();
+        break;
+    case type::object:
+        m_object = other.m_object;
+        break;
+    case type::integer:
+        m_int = other.m_int;
+        break;
+    case type::real:
+        m_double = other.m_double;
+        break;
+    case type::boolean:
+        m_bool = other.m_bool;
+        break;
+    default:
+        break;
+    }
+    m_type = other.m_type;
+    other.m_type = type::null;
+}
+
+void node::destroy() noexcept
+{
+    switch(m_type)
+    {
+    case type::string:
+        if(!is_small())
+            memory_scope::deallocate(m_large.data, m_large.size);
+        break;
+    case type::array:
+        m_array.~array();
+        break;
+    case type::object:
+        delete_object(m_object);
+        break;
+    default:
+        break;
+    }
+    m_type = type::null;
+}
@@ -0,0 +1,199 @@
+#include <string>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// optimization pass
+//
+
+namespace {
+
+/**
+ * @brief Rebuilds the tokens of a template, folding what does not depend on the context.
+ * The tokens are moved from the input as they are kept, the sections
+ * still being linked.
+ * Texts are appended to the last token while it is a text: contiguous views
+ * of a source are extended in place, anything else is copied to @a arena,
+ * which becomes a source of the template once done.
+ **/
+class folder
+{
+public:
+    folder(compiled_template & input):
+        m_input(input),
+        m_constants(m_empty)
+    {
+        m_output.reserve(input.size());
+        m_spans.reserve(input.size());
+    }
+
+    void fold(int ii_start, int ii_end)
+    {
+        for(int ii = ii_start; ii < ii_end; ++ii)
+        {
+            token & tok = m_input[ii];
+            switch(tok.op())
+            {
+            case opcode::text:
+                append(tok.text().text(), tok);
+                break;
+            case opcode::render:
+                {
+                    std::string rendered;
+                    if(tok.render().is_expression() && tok.render().expression().is_constant()
+                       && evaluate([&]() {
+                              string_sink sink(rendered);
+                              tok.render().expression().render(m_constants, sink);
+                              sink.flush();
+                          }))
+                        append(rendered, tok.position());
+                    else
+                        push(tok);
+                }
+                break;
+            case opcode::if_test:
+                {
+                    const expression & condition = tok.section().condition();
+                    bool taken = false;
+                    if(!condition.is_constant() || !evaluate([&]() { taken = condition.test(m_constants); }))
+                    {
+                        push(tok);
+                        break;
+                    }
+                    int else_branch = tok.jump();
+                    int endif = m_input[else_branch].op() == opcode::else_branch ? m_input[else_branch].jump() : else_branch;
+                    if(taken)
+                        fold(ii + 1, else_branch);
+                    else if(else_branch != endif)
+                        fold(else_branch + 1, endif);
+                    ii = endif;
+                }
+                break;
+            case opcode::block:
+            case opcode::endblock:
+            case opcode::extends:
+            case opcode::unknown:
+                // render nothing
+                break;
+            default:
+                push(tok);
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief The folded tokens, their merged texts held by a new source appended to @a sources.
+     **/
+    token_list finish(source_list & sources)
+    {
+        if(!m_arena.empty())
+        {
+            std::shared_ptr<const template_source> arena = template_source::from_string(std::move(m_arena));
+            for(std::size_t index = 0; index < m_output.size(); ++index)
+            {
+                if(m_spans[index].first != std::string::npos)
+                    m_output[index] = token(text_token(arena->text().substr(m_spans[index].first, m_spans[index].second)),
+                                            m_output[index].position());
+            }
+            sources.push_back(std::move(arena));
+        }
+        return std::move(m_output);
+    }
+
+private:
+    template<typename F>
+    static bool evaluate(F && fn)
+    {
+        try
+        {
+            fn();
+            return true;
+        }
+        catch(const renderer::render_exception &)
+        {
+            return false;
+        }
+    }
+
+    void push(token & tok)
+    {
+        m_output.push_back(std::move(tok));
+        m_spans.emplace_back(std::string::npos, 0);
+    }
+
+    /**
+     * @brief Append the text of @a tok, merged with the previous text if any.
+     **/
+    void append(std::string_view text, token & tok)
+    {
+        if(text.empty())
+            return;
+        if(!last_is_text())
+        {
+            push(tok);
+            return;
+        }
+        std::pair<std::size_t, std::size_t> & span = m_spans.back();
+        std::string_view last = m_output.back().text().text();
+        if(span.first == std::string::npos && last.data() + last.size() == text.data())
+        {
+            // following each other in the same source
+            m_output.back() = token(text_token(std::string_view(last.data(), last.size() + text.size())));
+            return;
+        }
+        append(text, tok.position());
+    }
+
+    /**
+     * @brief Append a text which is not in a source.
+     * @param position  Where the text comes from, for a new token.
+     **/
+    void append(std::string_view text, const char * position)
+    {
+        if(text.empty())
+            return;
+        if(!last_is_text())
+        {
+            m_output.push_back(token(text_token(std::string_view()), position));
+            m_spans.emplace_back(m_arena.size(), 0);
+        }
+        std::pair<std::size_t, std::size_t> & span = m_spans.back();
+        if(span.first == std::string::npos)
+        {
+            // copy the view the text is merged with
+            std::string_view last = m_output.back().text().text();
+            span = std::make_pair(m_arena.size(), last.size());
+            m_arena.append(last.data(), last.size());
+        }
+        // the last text is always the last one in the arena
+        m_arena.append(text.data(), text.size());
+        span.second += text.size();
+    }
+
+    inline bool last_is_text() const { return !m_output.empty() && m_output.back().op() == opcode::text; }
+
+    compiled_template & m_input;      ///< its kept tokens are moved out
+    dict m_empty;
+    const scope m_constants;        ///< context of the constant expressions
+    token_list m_output;
+    std::vector<std::pair<std::size_t, std::size_t>> m_spans;   ///< arena offset and length of the output texts, npos for views
+    std::string m_arena;
+};
+
+} // namespace
+
+std::size_t compiled_template::optimize()
+{
+    folder pass(*this);
+    pass.fold(0, static_cast<int>(size()));
+    token_list tokens = pass.finish(m_sources);
+
+    std::size_t removed = size() - tokens.size();
+    std::vector<token>::operator=(std::move(tokens));
+    link();
+    m_removed += removed;
+    return removed;
+}
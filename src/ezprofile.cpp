@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <ostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// render_profile stuff
+//
+
+render_profile::render_profile(const compiled_template & input):
+    m_program(input),
+    m_counters(input.size())
+{
+}
+
+void render_profile::clear()
+{
+    std::fill(m_counters.begin(), m_counters.end(), counters());
+}
+
+int render_profile::body_end(int index) const
+{
+    const token & tok = m_program[index];
+    switch(tok.op())
+    {
+    case opcode::for_loop:
+    case opcode::cache:
+        return tok.jump();
+    case opcode::if_test:
+        // the else branch is part of the if
+        return m_program[tok.jump()].op() == opcode::else_branch ? m_program[tok.jump()].jump() : tok.jump();
+    default:
+        return index + 1;
+    }
+}
+
+render_profile::counters render_profile::total(int index) const
+{
+    counters result = m_counters[index];
+    if(m_program[index].op() == opcode::if_test)
+    {
+        // the branches are run after the test, out of its probe
+        for(int child = index + 1, end = body_end(index); child < end; child = body_end(child))
+        {
+            counters branch = total(child);
+            result.nanoseconds += branch.nanoseconds;
+            result.bytes += branch.bytes;
+        }
+    }
+    return result;
+}
+
+render_profile::counters render_profile::self(int index) const
+{
+    counters result = total(index);
+    for(int child = index + 1, end = body_end(index); child < end; child = body_end(child))
+    {
+        // the clock is read by each probe: the sum of the children may exceed the section by a little
+        counters body = total(child);
+        result.nanoseconds -= std::min(result.nanoseconds, body.nanoseconds);
+        result.bytes -= std::min(result.bytes, body.bytes);
+    }
+    return result;
+}
+
+std::vector<render_profile::location> render_profile::locate() const
+{
+    std::vector<location> locations(m_program.size());
+    for(const std::shared_ptr<const template_source> & source: m_program.sources())
+    {
+        const std::string_view text = source->text();
+        std::vector<int> indexes;
+        for(int index = 0; index < static_cast<int>(m_program.size()); ++index)
+        {
+            const char * position = m_program[index].position();
+            if(position && position >= text.data() && position < text.data() + text.size())
+                indexes.push_back(index);
+        }
+        std::sort(indexes.begin(), indexes.end(), [this](int lhs, int rhs) {
+            return m_program[lhs].position() < m_program[rhs].position();
+        });
+
+        // a single sweep over the source counts the lines
+        const std::string file = source->path().empty() ? std::string() : boost::filesystem::path(source->path()).filename().string();
+        const char * counted = text.data();
+        int line = 1;
+        for(int index: indexes)
+        {
+            const char * position = m_program[index].position();
+            line += static_cast<int>(std::count(counted, position, '\n'));
+            counted = position;
+            locations[index].file = file;
+            locations[index].line = line;
+        }
+    }
+    return locations;
+}
+
+/**
+ * @brief A short, single line description of a token.
+ **/
+static std::string label(const token & tok)
+{
+    std::string text;
+    switch(tok.token_type())
+    {
+    case token::type::text:
+        text = "text";
+        break;
+    case token::type::render:
+        text = "{{" + tok.render().content() + "}}";
+        break;
+    case token::type::section:
+        text = "{%" + tok.section().content() + "%}";
+        break;
+    }
+    for(char & c: text)
+    {
+        if(c == '\n' || c == '\r' || c == '\t' || c == ';')
+            c = ' ';
+    }
+    if(text.size() > 48)
+        text = text.substr(0, 45) + "...";
+    return text;
+}
+
+/**
+ * @brief Whether a token is reported: the closing tags are only passed over.
+ **/
+static bool is_reported(const token & tok)
+{
+    return tok.op() != opcode::endfor && tok.op() != opcode::endif && tok.op() != opcode::endcache;
+}
+
+static std::string where(const render_profile::location & at)
+{
+    if(!at.line)
+        return "?";
+    return (at.file.empty() ? std::string("line ") : at.file + ":") + std::to_string(at.line);
+}
+
+void render_profile::write_table(std::ostream & out, std::size_t limit) const
+{
+    const std::vector<location> locations = locate();
+    std::vector<int> called;
+    std::vector<counters> selves(m_counters.size());
+    std::uint64_t overall = 0;
+    for(int index = 0; index < static_cast<int>(m_counters.size()); ++index)
+    {
+        if(!m_counters[index].calls || !is_reported(m_program[index]))
+            continue;
+        called.push_back(index);
+        selves[index] = self(index);
+        overall += selves[index].nanoseconds;
+    }
+    std::stable_sort(called.begin(), called.end(), [&selves](int lhs, int rhs) {
+        return selves[lhs].nanoseconds > selves[rhs].nanoseconds;
+    });
+    if(limit && called.size() > limit)
+        called.resize(limit);
+
+    char row[256];
+    std::snprintf(row, sizeof(row), "%-24s %10s %12s %12s %7s %12s  %s\n",
+                  "location", "calls", "total ms", "self ms", "self %", "bytes", "token");
+    out << row;
+    for(int index: called)
+    {
+        const counters all = total(index);
+        std::snprintf(row, sizeof(row), "%-24s %10llu %12.3f %12.3f %7.2f %12llu  ",
+                      where(locations[index]).c_str(),
+                      static_cast<unsigned long long>(all.calls),
+                      all.nanoseconds / 1e6,
+                      selves[index].nanoseconds / 1e6,
+                      overall ? 100.0 * selves[index].nanoseconds / overall : 0.0,
+                      static_cast<unsigned long long>(all.bytes));
+        out << row << label(m_program[index]) << '\n';
+    }
+}
+
+void render_profile::write_folded(std::ostream & out) const
+{
+    const std::vector<location> locations = locate();
+    // the enclosing sections of each token, as frames
+    std::vector<std::string> stack;
+    std::vector<int> ends;
+    for(int index = 0; index < static_cast<int>(m_counters.size()); ++index)
+    {
+        while(!ends.empty() && index >= ends.back())
+        {
+            ends.pop_back();
+            stack.pop_back();
+        }
+        std::string frame = where(locations[index]) + " " + label(m_program[index]);
+        const std::uint64_t nanoseconds = m_counters[index].calls && is_reported(m_program[index]) ? self(index).nanoseconds : 0;
+        if(nanoseconds)
+        {
+            for(const std::string & parent: stack)
+                out << parent << ';';
+            out << frame << ' ' << nanoseconds << '\n';
+        }
+        int end = body_end(index);
+        if(end > index + 1)
+        {
+            stack.push_back(std::move(frame));
+            ends.push_back(end);
+        }
+    }
+}
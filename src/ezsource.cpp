@@ -0,0 +1,133 @@
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <eztemp.h>
+
+using namespace ez::temp;
+
+// --------------------------------------------
+// template_source stuff
+//
+
+static renderer::compile_exception cannot_read(const std::string & path)
+{
+    std::stringstream ss;
+    ss << "ez::temp::compile: cannot read template: \"" << path << "\"";
+    return renderer::compile_exception(ss.str().c_str());
+}
+
+/**
+ * @brief Allows std::make_shared on the private constructor.
+ **/
+struct shared_template_source: public template_source
+{
+    shared_template_source() {}
+};
+
+std::shared_ptr<const template_source> template_source::from_file(const std::string & path, std::size_t mmap_threshold)
+{
+    std::shared_ptr<template_source> source = std::make_shared<shared_template_source>();
+    source->m_path = path;
+#ifdef _WIN32
+    boost::system::error_code ec;
+    std::uintmax_t size = boost::filesystem::file_size(path, ec);
+    if(ec)
+        throw cannot_read(path);
+
+    if(size > 0 && size >= mmap_threshold)
+    {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            source->m_mapping = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size) : nullptr;
+            // the view keeps the mapping alive
+            if(mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+        }
+    }
+    if(!source->m_mapping)
+    {
+        std::ifstream fs(path, std::ios::binary);
+        if(!fs)
+            throw cannot_read(path);
+        source->m_owned.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if(fd < 0)
+        throw cannot_read(path);
+    if(::fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        ::close(fd);
+        throw cannot_read(path);
+    }
+    std::size_t size = status.st_size;
+
+    if(size > 0 && size >= mmap_threshold)
+    {
+        void * address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(address != MAP_FAILED)
+        {
+#ifdef MADV_SEQUENTIAL
+            ::madvise(address, size, MADV_SEQUENTIAL);
+#endif
+            source->m_mapping = address;
+        }
+    }
+    if(!source->m_mapping)
+    {
+        // small file, or mapping not possible: read it
+        source->m_owned.resize(size);
+        std::size_t done = 0;
+        while(done < size)
+        {
+            ssize_t count = ::read(fd, &source->m_owned[done], size - done);
+            if(count <= 0)
+                break;
+            done += count;
+        }
+        source->m_owned.resize(done);
+    }
+    ::close(fd);
+#endif
+
+    if(source->m_mapping)
+        source->m_text = std::string_view(static_cast<const char *>(source->m_mapping), size);
+    else
+        source->m_text = source->m_owned;
+    return source;
+}
+
+std::shared_ptr<const template_source> template_source::from_string(std::string text)
+{
+    std::shared_ptr<template_source> source = std::make_shared<shared_template_source>();
+    source->m_owned = std::move(text);
+    source->m_text = source->m_owned;
+    return source;
+}
+
+template_source::~template_source()
+{
+    if(m_mapping)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_mapping);
+#else
+        ::munmap(m_mapping, m_text.size());
+#endif
+    }
+}
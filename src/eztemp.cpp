@@ -6,24 +6,34 @@
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
 #include <exception>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <functional>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <eztemp.h>
 
 using namespace ez::temp;
 
-std::map<std::string, renderer::render_function> renderer::m_functions;
+function_registry renderer::m_functions;
+fragment_cache renderer::m_cache;
 
 std::string render_token::m_start_tag = "{{";
 std::string render_token::m_end_tag = "}}";
@@ -32,113 +42,62 @@ std::string section_token::m_end_tag = "%}";
 
 /**
  * @brief The render_node_visitor class
+ * Writes a leaf node into an output sink.
  **/
-class render_node_visitor: public boost::static_visitor<std::string>
+class render_node_visitor
 {
 public:
-    render_node_visitor(const std::vector<std::string> & keys, int level = 1): boost::static_visitor<std::string>(), m_keys(keys), m_level(level) {}
-    std::string operator()(std::nullptr_t) const
+    render_node_visitor(output_sink & output): m_output(output) {}
+    void operator()(std::nullptr_t) const
     {
-        return "null";
+        m_output.write("null", 4);
     }
-    std::string operator()(int val) const
+    void operator()(int val) const
     {
-        return std::to_string(val);
+        char buffer[16];
+        int size = std::snprintf(buffer, sizeof(buffer), "%d", val);
+        m_output.write(buffer, size);
     }
-    std::string operator()(double val) const
+    void operator()(double val) const
     {
-        return std::to_string(val);
+        // shortest representation reading back as the same value
+        char buffer[32];
+        int size = std::snprintf(buffer, sizeof(buffer), "%.15g", val);
+        if(std::strtod(buffer, nullptr) != val)
+            size = std::snprintf(buffer, sizeof(buffer), "%.17g", val);
+        m_output.write(buffer, size);
     }
-    std::string operator()(bool val) const
+    void operator()(bool val) const
     {
-        return val ? "true" : "false";
+        if(val)
+            m_output.write("true", 4);
+        else
+            m_output.write("false", 5);
     }
-    std::string operator()(const std::string & val) const
+    void operator()(std::string_view val) const
     {
-        return val;
+        m_output.write(val.data(), val.size());
     }
-    std::string operator ()(const std::map<const std::string, node> & map) const
+    void operator ()(const object & /*map*/) const
     {
-        return boost::apply_visitor(render_node_visitor(m_keys, m_level + 1), map.at(m_keys.at(m_level)));
+        throw renderer::render_exception("Tho shall not render a dict !!!");
     }
-    std::string operator ()(const array & var) const
+    void operator ()(const array & /*var*/) const
     {
         throw renderer::render_exception("Tho shall not render an array !!!");
     }
-    std::string operator ()(const std::map<const std::string, boost::recursive_variant_> & var) const
-    {
-        return "";
-    }
-    template <typename T, typename U>
-    std::string operator()( const T &, const U & ) const
-    {
-        return "";
-    }
-    template <typename T>
-    std::string operator()( const T & lhs, const T & rhs ) const
-    {
-        return "";
-    }
 private:
-    std::vector<std::string> m_keys;
-    int m_level;
-};
-
-
-class get_type_node_visitor: public boost::static_visitor<std::string>
-{
-public:
-    std::string operator()(std::nullptr_t) const
-    {
-        return "nullptr_t";
-    }
-    std::string operator()(int val) const
-    {
-        return "int";
-    }
-    std::string operator()(double val) const
-    {
-        return "double";
-    }
-    std::string operator()(bool val) const
-    {
-        return "bool";
-    }
-    std::string operator()(const std::string & val) const
-    {
-        return "string";
-    }
-    std::string operator ()(const std::map<const std::string, node> & map) const
-    {
-        return "dict";
-    }
-    std::string operator ()(const array & var) const
-    {
-        return "array";
-    }
-    /*std::string operator ()(const std::map<const std::string, boost::recursive_variant_> & var) const
-    {
-        return "";
-    }*/
-    template <typename T, typename U>
-    std::string operator()( const T &, const U & ) const
-    {
-        return "unknown";
-    }
-    template <typename T>
-    std::string operator()( const T & lhs, const T & rhs ) const
-    {
-        return "unknown";
-    }
+    output_sink & m_output;
 };
 
 /**
  * @brief The bool_check_node_visitor class
+ * null, false, 0, "false" and empty strings, arrays and objects test false,
+ * other values true, as string values of expressions do.
  **/
-class bool_check_node_visitor: public boost::static_visitor<bool>
+class bool_check_node_visitor
 {
 public:
-    bool_check_node_visitor(const std::vector<std::string> & keys, int level = 1): boost::static_visitor<bool>(), m_keys(keys), m_level(level) {}
     bool operator()(std::nullptr_t) const
     {
         return false;
@@ -155,47 +114,18 @@ public:
     {
         return val;
     }
-    bool operator()(const std::string & val) const
-    {
-        if(val == "true")
-            return true;
-        else if(val == "false")
-            return false;
-        else throw std::runtime_error("Not a boolean string");
-    }
-    bool operator ()(const std::map<const std::string, node> & map) const
-    {
-        /*if(m_keys.size() == 1)
-        {
-            // try to get the "value" key
-            return boost::apply_visitor(bool_check_node_visitor(m_keys, m_level + 1), map.at("value"));
-        }
-        else
-        {*/
-            return boost::apply_visitor(bool_check_node_visitor(m_keys, m_level + 1), map.at(m_keys.at(m_level)));
-        //}
-    }
-    bool operator ()(const node & var) const
-    {
-        throw std::runtime_error("Not a boolean");
-    }
-    bool operator ()(const std::map<const std::string, boost::recursive_variant_> & var) const
+    bool operator()(std::string_view val) const
     {
-        throw std::runtime_error("Not a boolean");
+        return renderer::test_string(val);
     }
-    template <typename T, typename U>
-    bool operator()( const T &, const U & ) const
+    bool operator ()(const object & map) const
     {
-        throw std::runtime_error("Not a boolean");
+        return !map.empty();
     }
-    template <typename T>
-    bool operator()( const T & lhs, const T & rhs ) const
+    bool operator ()(const array & var) const
     {
-        throw std::runtime_error("Not a boolean");
+        return !var.empty();
     }
-private:
-    std::vector<std::string> m_keys;
-    int m_level;
 };
 
 /**
@@ -211,23 +141,20 @@ inline void remove_whitespaces(std::string & str)
 /**
  * @brief get_next_section
  * @param tokens
- * @param name
+ * @param op
  * @param section
  * @param start_index
  * @return
  */
 inline static
-int get_next_section(const compiled_template & tokens, const std::string & name, std::shared_ptr<section_token> & section,int start_index = 0)
+int get_next_section(const token_list & tokens, opcode op, const section_token * & section,int start_index = 0)
 {
     for(int ii = start_index; ii < tokens.size(); ++ii)
     {
-        if(tokens[ii]->token_type() == token::type::section)
+        if(tokens[ii].op() == op)
         {
-            section = std::dynamic_pointer_cast<section_token>(tokens[ii]);
-            if(section->params()[0] == name)
-            {
-                return ii;
-            }
+            section = &tokens[ii].section();
+            return ii;
         }
     }
     return -1;
@@ -241,11 +168,11 @@ int get_next_section(const compiled_template & tokens, const std::string & name,
  * @return
  */
 inline static
-int get_next_block(compiled_template & list, int start_index, std::string & block_name)
+int get_next_block(const token_list & list, int start_index, std::string & block_name)
 {
-    std::shared_ptr<section_token> section;
+    const section_token * section = nullptr;
     int index;
-    if((index = get_next_section(list, "block", section, start_index)) != -1)
+    if((index = get_next_section(list, opcode::block, section, start_index)) != -1)
     {
         block_name = section->params()[1];
         return index;
@@ -260,11 +187,11 @@ int get_next_block(compiled_template & list, int start_index, std::string & bloc
  * @return
  */
 inline static
-int get_next_endblock(compiled_template & list, int start_index)
+int get_next_endblock(const token_list & list, int start_index)
 {
-    std::shared_ptr<section_token> section;
+    const section_token * section = nullptr;
     int index;
-    if((index = get_next_section(list, "endblock", section, start_index)) != -1)
+    if((index = get_next_section(list, opcode::endblock, section, start_index)) != -1)
     {
         return index;
     }
@@ -278,11 +205,11 @@ int get_next_endblock(compiled_template & list, int start_index)
  * @return
  */
 inline static
-int get_named_block (compiled_template & list,std::string block_name)
+int get_named_block (const token_list & list,std::string block_name)
 {
-    std::shared_ptr<section_token> section;
+    const section_token * section = nullptr;
     int index = 0;
-    while((index = get_next_section(list, "block", section, index)) != -1)
+    while((index = get_next_section(list, opcode::block, section, index)) != -1)
     {
         if(block_name == section->params()[1])
             return index;
@@ -292,106 +219,430 @@ int get_named_block (compiled_template & list,std::string block_name)
 }
 
 // --------------------------------------------
-// dict stuff
+// function_registry stuff
 //
 
-dict dict::from_json(const std::string &json)
+void function_registry::add(const std::string & key, const render_function & function)
 {
-    dict context;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(frozen())
+        throw std::logic_error("ez::temp::function_registry: cannot add \"" + key + "\" to a frozen registry");
+    m_functions[key] = function;
+}
 
-    std::stringstream ss;
-    ss << json;
-    boost::property_tree::ptree pt;
-    boost::property_tree::read_json(ss, pt);
-    using boost::property_tree::ptree;
-    std::function<void(const std::string&, ptree&, dict &, const std::string&)> parse_node;
-    parse_node = [&parse_node](const std::string& key, ptree & pt, dict & context, const std::string& parent_key){
-        if(pt.empty())
+void function_registry::freeze()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frozen.store(true, std::memory_order_release);
+}
+
+const render_function * function_registry::find(const std::string & key) const
+{
+    if(frozen())
+    {
+        auto it = m_functions.find(key);
+        return it != m_functions.end() ? &it->second : nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_functions.find(key);
+    return it != m_functions.end() ? &it->second : nullptr;
+}
+
+// --------------------------------------------
+// fd_sink stuff
+//
+
+fd_sink::fd_sink(int fd, std::size_t threshold):
+    m_fd(fd),
+    m_threshold(threshold)
+{
+    m_buffer.reserve(threshold);
+}
+
+fd_sink::~fd_sink()
+{
+    try
+    {
+        flush();
+    }
+    catch(const std::exception & e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+void fd_sink::write(const char * data, std::size_t size)
+{
+    m_buffer.append(data, size);
+    if(m_buffer.size() >= m_threshold)
+        flush();
+}
+
+void fd_sink::flush()
+{
+    const char * data = m_buffer.data();
+    std::size_t remaining = m_buffer.size();
+    while(remaining > 0)
+    {
+#ifdef _WIN32
+        int written = ::_write(m_fd, data, static_cast<unsigned int>(remaining));
+#else
+        ssize_t written = ::write(m_fd, data, remaining);
+#endif
+        if(written < 0)
+        {
+            m_buffer.clear();
+            throw std::runtime_error("ez::temp::fd_sink: write failed");
+        }
+        data += written;
+        remaining -= written;
+    }
+    m_buffer.clear();
+}
+
+// --------------------------------------------
+// scope stuff
+//
+
+/**
+ * @brief The provided_values class
+ * Memoizes the values of a context_provider by key path, misses included.
+ **/
+class ez::temp::provided_values
+{
+public:
+    provided_values(context_provider & provider): m_provider(provider) {}
+
+    const node * find(const std::vector<std::string> & keys)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_values.find(keys);
+        if(it == m_values.end())
+            it = insert(keys, resolve(keys));
+        return it->second.found;
+    }
+
+    std::unique_ptr<sequence> iterate(const std::vector<std::string> & keys)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // a resolved array is used as is
+        auto it = m_values.find(keys);
+        if(it != m_values.end() && it->second.found)
+            return nullptr;
+        return m_provider.iterate(keys);
+    }
+
+private:
+    struct value
+    {
+        node owned;                     ///< the value given by the provider
+        const node * found = nullptr;   ///< owned, or in the object of a prefix, null if none
+    };
+
+    using values = std::map<std::vector<std::string>, value>;
+
+    values::iterator insert(const std::vector<std::string> & keys, value && v)
+    {
+        const bool owned = v.found == &v.owned;
+        values::iterator it = m_values.emplace(keys, std::move(v)).first;
+        if(owned)
+            it->second.found = &it->second.owned;
+        return it;
+    }
+
+    /**
+     * @brief Ask the provider for @a keys, then for its prefixes.
+     * @throw render_exception naming the path if a prefix is not an object.
+     **/
+    value resolve(const std::vector<std::string> & keys)
+    {
+        value result;
+        if(m_provider.resolve(keys, result.owned))
+        {
+            result.found = &result.owned;
+            return result;
+        }
+        std::vector<std::string> prefix(keys.begin(), keys.end() - 1);
+        for(; !prefix.empty(); prefix.pop_back())
         {
-            if(key.empty())
+            auto it = m_values.find(prefix);
+            if(it == m_values.end())
             {
-                if(context.find(parent_key) != context.end())
-                {
-                    boost::get<std::vector<node>>(context[parent_key]).push_back(pt.data());
-                }
-                else
-                {
-                    context[parent_key] = std::vector<node>{pt.data()};
-                }
+                value asked;
+                if(m_provider.resolve(prefix, asked.owned))
+                    asked.found = &asked.owned;
+                it = insert(prefix, std::move(asked));
             }
-            else
+            if(it->second.found)
             {
-                context[key] = pt.data();
+                const node * current = it->second.found;
+                for(std::size_t level = prefix.size(); current && level < keys.size(); ++level)
+                {
+                    if(!current->is_object())
+                    {
+                        std::stringstream ss;
+                        ss << "ez::temp::render: \"" << boost::algorithm::join(keys, ".") << "\": \""
+                           << boost::algorithm::join(std::vector<std::string>(keys.begin(), keys.begin() + level), ".")
+                           << "\" is " << current->type_name() << ", not object";
+                        throw renderer::render_exception(ss.str().c_str());
+                    }
+                    const object & members = current->as_object();
+                    auto member = members.find(keys[level]);
+                    current = member != members.end() ? &member->second : nullptr;
+                }
+                result.found = current;
+                return result;
             }
         }
-        else
+        return result;
+    }
+
+    context_provider & m_provider;
+    values m_values;    ///< nodes never move in a map
+    std::mutex m_mutex;
+};
+
+scope::scope(const dict & context, provided_values * provided):
+    m_context(&context),
+    m_provided(provided),
+    m_parent(nullptr),
+    m_name(nullptr),
+    m_value(nullptr),
+    m_index(-1)
+{}
+
+scope::scope(const scope & parent, const std::string & name, int length, int first):
+    m_context(nullptr),
+    m_provided(parent.m_provided),
+    m_parent(&parent),
+    m_name(&name),
+    m_value(nullptr),
+    m_loop(object{
+        {"length", length},
+        {"index", 0}, {"index0", 0},
+        {"first", false}, {"last", false},
+        {"revindex", 0}, {"revindex0", 0},
+    }),
+    m_index(first - 1)
+{}
+
+void scope::next(const node & value)
+{
+    m_value = &value;
+    ++m_index;
+    object & loop = m_loop.as_object();
+    int size = loop["length"].as_int();
+    loop["index"] = m_index + 1;
+    loop["index0"] = m_index;
+    loop["first"] = m_index == 0;
+    loop["last"] = m_index == size - 1;
+    loop["revindex"] = size - m_index;
+    loop["revindex0"] = size - m_index - 1;
+}
+
+const node * scope::lookup(const std::vector<std::string> & keys, std::size_t & level) const
+{
+    const std::string & key = keys.at(0);
+    const scope * current = this;
+    for(; current->m_parent; current = current->m_parent)
+    {
+        if(key == *current->m_name)
+        {
+            return current->m_value;
+        }
+        else if(key == "loop")
         {
-            for (ptree::iterator node = pt.begin(); node != pt.end(); ++node)
+            // walk up loop.parent.parent..., not found past the outermost loop
+            for(; level < keys.size() && keys[level] == "parent"; ++level)
             {
-                parse_node(node->first, node->second, context, key);
+                current = current->m_parent;
+                if(!current->m_parent)
+                    return nullptr;
             }
+            return &current->m_loop;
         }
-    };
+    }
+    auto it = current->m_context->find(key);
+    if(it != current->m_context->end())
+        return &it->second;
+    if(current->m_provided)
+    {
+        level = keys.size();
+        return current->m_provided->find(keys);
+    }
+    return nullptr;
+}
+
+std::unique_ptr<sequence> scope::iterate(const std::vector<std::string> & keys) const
+{
+    if(!m_provided)
+        return nullptr;
+    const std::string & key = keys.at(0);
+    const scope * current = this;
+    for(; current->m_parent; current = current->m_parent)
+    {
+        if(key == *current->m_name || key == "loop")
+            return nullptr;
+    }
+    if(current->m_context->count(key))
+        return nullptr;
+    return m_provided->iterate(keys);
+}
+
+const node & scope::at(const std::vector<std::string> & keys) const
+{
+    std::size_t level = 1;
+    const node * current = lookup(keys, level);
+    if(!current)
+        throw std::out_of_range("ez::temp::scope: no value at " + boost::algorithm::join(keys, "."));
+    for(; level < keys.size(); ++level)
+    {
+        current = &current->as_object().at(keys[level]);
+    }
+    return *current;
+}
 
-    parse_node("", pt, context, "");
-    return context;
+const node * scope::find(const std::vector<std::string> & keys) const
+{
+    std::size_t level = 1;
+    const node * current = lookup(keys, level);
+    for(; current && level < keys.size(); ++level)
+    {
+        if(!current->is_object())
+            return nullptr;
+        const object & members = current->as_object();
+        auto it = members.find(keys[level]);
+        current = it != members.end() ? &it->second : nullptr;
+    }
+    return current;
 }
 
 // --------------------------------------------
 // render_token stuff
 //
 
+/**
+ * @brief parse_key_path
+ * @param str   Whitespace free dotted key path (eg.: "loop.parent.index").
+ * @param keys  Resulting keys.
+ * @return false if the path is malformed.
+ */
+static bool parse_key_path(const std::string & str, std::vector<std::string> & keys)
+{
+    keys = split(str, '.');
+    for(const std::string & key: keys)
+    {
+        if(key.empty() || key.find_first_of("(),") != std::string::npos)
+            return false;
+    }
+    return true;
+}
+
 render_token::render_token(const std::string & content):
-    token(token::type::render),
-    m_content(std::string(content.begin() + m_start_tag.size(), content.end() - m_end_tag.size()))
-{}
+    m_content(std::string(content.begin() + m_start_tag.size(), content.end() - m_end_tag.size())),
+    m_callable(nullptr)
+{
+    std::string expr = m_content;
+    remove_whitespaces(expr);
+
+    auto syntax_error = [this]() {
+        std::stringstream ss;
+        ss << "ez::temp::compile: invalid expression: \"" << m_content << "\"";
+        return renderer::compile_exception(ss.str().c_str());
+    };
 
-std::string render_token::render(const dict & context){
-   std::string full_key = m_content;
-   remove_whitespaces(full_key);
-   static const boost::regex expr("([a-zA-Z_]+)\\((.*)\\)$");
-   boost::cmatch what;
-   if(boost::regex_match(full_key.c_str(), what, expr))
+    // anything but a key path or a call of a template function is an expression
+    auto parse_expression = [this]() {
+        m_function.clear();
+        m_callable = nullptr;
+        m_arguments.clear();
+        m_expression.emplace(m_content);
+    };
+
+    std::size_t open = expr.find('(');
+    if(open == std::string::npos)
+    {
+        if(ez::temp::expression::is_key_path(m_content))
+        {
+            if(!parse_key_path(expr, m_keys))
+                throw syntax_error();
+            return;
+        }
+        parse_expression();
+        return;
+    }
+
+    // function call: name(arg, other.arg, ...)
+    m_function = expr.substr(0, open);
+    if(m_function.empty() || expr.back() != ')'
+       || std::find_if(m_function.begin(), m_function.end(), [](char c){ return !std::isalpha(c) && c != '_'; }) != m_function.end())
+    {
+        parse_expression();
+        return;
+    }
+
+    m_callable = renderer::functions().find(m_function);
+    if(!m_callable)
+    {
+        try
+        {
+            parse_expression();
+            return;
+        }
+        catch(const renderer::compile_exception &)
+        {
+            std::stringstream ss;
+            ss << "ez::temp::compile: unknown function: \"" << expr.substr(0, open) << "\"";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+    }
+
+    std::string params_raw = expr.substr(open + 1, expr.size() - open - 2);
+    if(!params_raw.empty())
+    {
+        for(const std::string & p: split(params_raw, ','))
+        {
+            std::vector<std::string> keys;
+            if(!parse_key_path(p, keys))
+            {
+                parse_expression();
+                return;
+            }
+            m_arguments.push_back(keys);
+        }
+    }
+}
+
+void render_token::render(const scope & context, output_sink & output) const {
+   if(is_expression())
+   {
+       m_expression->render(context, output);
+   }
+   else if(is_function())
    {
        array nl;
-       std::string function_name = what[1];
-       std::string params_raw = what[2];
-       remove_whitespaces(params_raw);
-       std::vector<std::string> params = split(params_raw,',');
-       for(const std::string & p: params)
+       nl.reserve(m_arguments.size());
+       for(const std::vector<std::string> & arg: m_arguments)
        {
-           if(!p.empty())
-           {
-               const node & _n = context.at(p);
-               nl.push_back(_n);
-           }
+           nl.push_back(renderer::value_at(context, arg));
        }
-       return renderer::call_function(function_name, nl);
+       output.write((*m_callable)(nl));
    }
    else
    {
-       const std::vector<std::string> keys = split(full_key, '.');
-       return boost::apply_visitor(render_node_visitor(keys), context.at(keys.at(0)));
+       renderer::write_value(renderer::value_at(context, m_keys), output);
    }
 }
 
 bool render_token::is_start(std::string::const_iterator start, const std::string::const_iterator & end)
 {
-    for(std::string::const_iterator it = m_start_tag.begin(); it < m_start_tag.end(); ++it, ++start)
-    {
-        if((*it) != *(start))
-            return false;
-    }
-    return true;
+    return std::distance(start, end) >= static_cast<std::ptrdiff_t>(m_start_tag.size())
+        && std::equal(m_start_tag.begin(), m_start_tag.end(), start);
 }
 bool render_token::is_end(std::string::const_iterator start, const std::string::const_iterator & end)
 {
-    for(std::string::const_iterator it = m_end_tag.begin(); it < m_end_tag.end(); ++it, ++start)
-    {
-        if((*it) != *(start))
-            return false;
-    }
-    return true;
+    return std::distance(start, end) >= static_cast<std::ptrdiff_t>(m_end_tag.size())
+        && std::equal(m_end_tag.begin(), m_end_tag.end(), start);
 }
 
 // --------------------------------------------
@@ -399,7 +650,6 @@ bool render_token::is_end(std::string::const_iterator start, const std::string::
 //
 
 section_token::section_token(const std::string & content):
-    token(token::type::section),
     m_content(std::string(content.begin() + m_start_tag.size(), content.end() - m_end_tag.size()))
 {
     m_params = split(m_content, ' ');
@@ -411,164 +661,309 @@ section_token::section_token(const std::string & content):
 
     // remove all blank params
     m_params.erase(std::remove(m_params.begin(), m_params.end(), ""), m_params.end());
+
+    static const std::map<std::string, opcode> opcodes = {
+        {"for", opcode::for_loop},
+        {"endfor", opcode::endfor},
+        {"if", opcode::if_test},
+        {"else", opcode::else_branch},
+        {"endif", opcode::endif},
+        {"block", opcode::block},
+        {"endblock", opcode::endblock},
+        {"extends", opcode::extends},
+        {"cache", opcode::cache},
+        {"endcache", opcode::endcache},
+    };
+    auto it = m_params.empty() ? opcodes.end() : opcodes.find(m_params[0]);
+    m_op = it != opcodes.end() ? it->second : opcode::unknown;
+
+    if(m_op == opcode::for_loop)
+    {
+        // for <name> in <key.path> [parallel]
+        m_parallel = m_params.size() == 5 && m_params[4] == "parallel";
+        if((m_params.size() != 4 && !m_parallel) || m_params[2] != "in")
+        {
+            std::stringstream ss;
+            ss << "ez::temp::compile: invalid for loop: \"" << m_content << "\"";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+        m_loop_keys = split(m_params[3], '.');
+    }
+    else if(m_op == opcode::if_test)
+    {
+        std::size_t start = m_content.find("if") + 2;
+        m_condition.emplace(m_content.substr(start));
+    }
+    else if(m_op == opcode::cache)
+    {
+        // cache <key expression> [<ttl seconds>]
+        if(m_params.size() < 2)
+        {
+            std::stringstream ss;
+            ss << "ez::temp::compile: invalid cache section: \"" << m_content << "\"";
+            throw renderer::compile_exception(ss.str().c_str());
+        }
+        std::size_t start = m_content.find("cache") + 5;
+        char * number_end = nullptr;
+        if(m_params.size() > 2)
+        {
+            const std::string & last = m_params.back();
+            double ttl = std::strtod(last.c_str(), &number_end);
+            if(*number_end == '\0' && ttl >= 0)
+            {
+                // the number is the ttl after a whole key ("a 60"), not the end of one ("a + 60")
+                try
+                {
+                    m_key.emplace(m_content.substr(start, m_content.rfind(last) - start));
+                    m_ttl = ttl;
+                }
+                catch(const renderer::compile_exception &)
+                {
+                }
+            }
+        }
+        if(!m_key)
+            m_key.emplace(m_content.substr(start));
+    }
 }
 
 bool section_token::is_start(std::string::const_iterator start, const std::string::const_iterator & end)
 {
-    for(std::string::const_iterator it = m_start_tag.begin(); it < m_start_tag.end(); ++it, ++start)
-    {
-        if((*it) != *(start))
-            return false;
-    }
-    return true;
+    return std::distance(start, end) >= static_cast<std::ptrdiff_t>(m_start_tag.size())
+        && std::equal(m_start_tag.begin(), m_start_tag.end(), start);
 }
 
 bool section_token::is_end(std::string::const_iterator start, const std::string::const_iterator & end)
 {
-    for(std::string::const_iterator it = m_end_tag.begin(); it < m_end_tag.end(); ++it, ++start)
-    {
-        if((*it) != *(start))
-            return false;
-    }
-    return true;
+    return std::distance(start, end) >= static_cast<std::ptrdiff_t>(m_end_tag.size())
+        && std::equal(m_end_tag.begin(), m_end_tag.end(), start);
 }
 
 // --------------------------------------------
-// renderer stuff
+// compiled_template stuff
 //
 
-compiled_template renderer::compile_file(const std::string &file_path)
+compiled_template::compiled_template(token_list tokens, source_list sources):
+    std::vector<token>(std::move(tokens)),
+    m_sources(std::move(sources))
 {
-    std::ifstream fs(file_path);
-    std::string path = boost::filesystem::path(file_path).remove_filename().string();
-    if(path.empty())
-        path = ".";
-    return compile(std::string(std::istreambuf_iterator<char>(fs),std::istreambuf_iterator<char>()), path);
+    link();
 }
 
-compiled_template renderer::compile(const std::string &input, const std::string & path)
+void compiled_template::link()
 {
-    compiled_template tokens;
+    std::vector<int> open_sections;
 
-    auto push_text_if_required = [&input](compiled_template & list, std::string::const_iterator begin, std::string::const_iterator end){
-        if(begin != end)
-        {
-            list.push_back(std::shared_ptr<token>(new text_token(std::string(begin, end))));
-        }
+    auto unbalanced = [](const std::string & what) {
+        std::stringstream ss;
+        ss << "ez::temp::compile: unbalanced section: \"" << what << "\"";
+        return renderer::compile_exception(ss.str().c_str());
     };
 
-    std::string::const_iterator last_it = input.begin();
-    std::string::const_iterator it = input.begin();
-    for(; it < input.end(); ++it)
+    for(int index = 0; index < static_cast<int>(size()); ++index)
     {
-        if(render_token::is_start(it, input.end()))
+        token & tok = (*this)[index];
+        switch(tok.op())
         {
-            std::string::const_iterator it_start = it;
-            for(; it < input.end(); ++it)
+        case opcode::for_loop:
+        case opcode::if_test:
+        case opcode::cache:
+            open_sections.push_back(index);
+            break;
+        case opcode::else_branch:
+            if(open_sections.empty() || (*this)[open_sections.back()].op() != opcode::if_test)
+                throw unbalanced("else");
+            (*this)[open_sections.back()].m_jump = index;
+            tok.m_jump = open_sections.back(); // temporarily points to the if
+            open_sections.back() = index;
+            break;
+        case opcode::endfor:
+            if(open_sections.empty() || (*this)[open_sections.back()].op() != opcode::for_loop)
+                throw unbalanced("endfor");
+            (*this)[open_sections.back()].m_jump = index;
+            tok.m_jump = open_sections.back();
+            open_sections.pop_back();
+            break;
+        case opcode::endcache:
+            if(open_sections.empty() || (*this)[open_sections.back()].op() != opcode::cache)
+                throw unbalanced("endcache");
+            (*this)[open_sections.back()].m_jump = index;
+            tok.m_jump = open_sections.back();
+            open_sections.pop_back();
+            break;
+        case opcode::endif:
+            if(open_sections.empty())
+                throw unbalanced("endif");
+            else
             {
-                if(render_token::is_end(it, input.end()))
+                token & open = (*this)[open_sections.back()];
+                if(open.op() == opcode::if_test)
                 {
-                    push_text_if_required(tokens, last_it, it_start);
-                    it += render_token::end_tag().size();
-                    tokens.push_back(std::shared_ptr<token>(new render_token(std::string(it_start, it))));
-                    last_it = it;
-                    --it;
-                    break;
+                    open.m_jump = index;
+                    tok.m_jump = open_sections.back();
                 }
-            }
-        }
-        else if(section_token::is_start(it, input.end()))
-        {
-            std::string::const_iterator it_start = it;
-            for(; it < input.end(); ++it)
-            {
-                if(section_token::is_end(it, input.end()))
+                else if(open.op() == opcode::else_branch)
                 {
-                    // clean pre-section (remove spaces)
-                    int pos = std::distance(input.begin(), it_start);
-                    int prev_nl = input.rfind('\n', pos);
-                    bool remove = false;
-                    if(prev_nl != std::string::npos)
-                    {
-                        int dist = pos - prev_nl;
-                        remove = true;
-                        if(dist != 0)
-                        {
-                            for(std::string::const_iterator it = it_start - dist + 1; it < it_start; ++it)
-                            {
-                                if((*it) != ' ' && (*it) != '\t')
-                                {
-                                    remove = false;
-                                    break;
-                                }
-                            }
-                        }
-                        else remove = false;
-                        if(remove)
-                        {
-                            push_text_if_required(tokens, last_it, it_start - dist);
-                        }
-                        else
-                        {
-                            push_text_if_required(tokens, last_it, it_start);
-                        }
-                    }
-                    else
-                    {
-                        push_text_if_required(tokens, last_it, it_start);
-                    }
-
-                    it += section_token::end_tag().size();
-                    tokens.push_back(std::shared_ptr<token>(new section_token(std::string(it_start, it))));
-                    last_it = it;
-
-                    --it;
-                    break;
+                    tok.m_jump = open.m_jump;
+                    open.m_jump = index;
                 }
+                else throw unbalanced("endif");
             }
+            open_sections.pop_back();
+            break;
+        default:
+            break;
         }
     }
-    push_text_if_required(tokens, last_it, it);
+
+    if(!open_sections.empty())
+    {
+        throw unbalanced((*this)[open_sections.back()].section().params()[0]);
+    }
+}
+
+compiled_template renderer::compile_file(const std::string &file_path, bool optimize)
+{
+    source_list sources;
+    token_list tokens = tokenize_file(file_path, sources);
+    compiled_template prog(std::move(tokens), std::move(sources));
+    if(optimize)
+        prog.optimize();
+    return prog;
+}
+
+compiled_template renderer::compile(const std::string &input, const std::string & path, bool optimize)
+{
+    return compile(std::string(input), path, optimize);
+}
+
+compiled_template renderer::compile(std::string &&input, const std::string & path, bool optimize)
+{
+    source_list sources;
+    token_list tokens = tokenize(template_source::from_string(std::move(input)), path, sources);
+    compiled_template prog(std::move(tokens), std::move(sources));
+    if(optimize)
+        prog.optimize();
+    return prog;
+}
+
+token_list renderer::tokenize_file(const std::string &file_path, source_list & sources)
+{
+    std::string path = boost::filesystem::path(file_path).remove_filename().string();
+    if(path.empty())
+        path = ".";
+    return tokenize(template_source::from_file(file_path), path, sources);
+}
+
+token_list renderer::tokenize(std::shared_ptr<const template_source> source, const std::string & path, source_list & sources)
+{
+    token_list tokens = lex(source->text());
+    sources.push_back(std::move(source));
 
     // check for extends
-    std::string extending_base;
+    std::string extending_base = extends_base(tokens);
+    if(!extending_base.empty())
+    {
+        return extend(tokenize_file(path + "/" + extending_base + ".ez", sources), tokens);
+    }
+    return tokens;
+}
 
-    std::shared_ptr<section_token> section;
-    int index;
-    if((index = get_next_section(tokens, "extends", section, 0)) >= 0)
+std::string renderer::extends_base(const token_list & tokens)
+{
+    const section_token * section = nullptr;
+    if(get_next_section(tokens, opcode::extends, section, 0) >= 0)
     {
-        // extending ...
+        return section->params().at(1);
+    }
+    return std::string();
+}
 
-        extending_base = section->params()[1];
-        compiled_template base_tokens = compile_file(path + "/" + extending_base + ".ez" );
+token_list renderer::extend(token_list base_tokens, const token_list & tokens)
+{
+    std::string block_name;
 
-        std::string block_name;
+    int index_base = 0;
+    int index = 0;
+    while((index_base = get_next_block(base_tokens, index_base, block_name)) != -1)
+    {
+        int index_endblock_base = get_next_endblock(base_tokens, index_base);
 
-        int index_base = 0;
-        int index = 0;
-        while((index_base = get_next_block(base_tokens, index_base, block_name)) != -1)
+        if((index = get_named_block(tokens, block_name)) != -1)
         {
-            int index_endblock_base = get_next_endblock(base_tokens, index_base);
+            // erase base content
+            base_tokens.erase(base_tokens.begin() + index_base, base_tokens.begin() + index_endblock_base);
 
-            if((index = get_named_block(tokens, block_name)) != -1)
-            {
-                // erase base content
-                base_tokens.erase(base_tokens.begin() + index_base, base_tokens.begin() + index_endblock_base);
-
-                int index_endblock = get_next_endblock(tokens, index);
-                base_tokens.insert(base_tokens.begin() + index_base, tokens.begin() + index + 1, tokens.begin() + index_endblock);
-                index = 0;
-            }
-            else
-            {
-                base_tokens.erase(base_tokens.begin() + index_endblock_base);   // remove the endblock section
-                base_tokens.erase(base_tokens.begin() + index_base);            // remove the block section
-            }
+            int index_endblock = get_next_endblock(tokens, index);
+            base_tokens.insert(base_tokens.begin() + index_base, tokens.begin() + index + 1, tokens.begin() + index_endblock);
+            index = 0;
+        }
+        else
+        {
+            base_tokens.erase(base_tokens.begin() + index_endblock_base);   // remove the endblock section
+            base_tokens.erase(base_tokens.begin() + index_base);            // remove the block section
         }
-        tokens = base_tokens;
     }
+    return base_tokens;
+}
 
-    return tokens;
+void renderer::write_value(const node & value, output_sink & output)
+{
+    visit(render_node_visitor(output), value);
+}
+
+bool renderer::test_value(const node & value)
+{
+    return visit(bool_check_node_visitor(), value);
+}
+
+bool renderer::test_string(std::string_view value)
+{
+    return !value.empty() && value != "false";
+}
+
+const array & renderer::loop_array(const scope & context, const std::vector<std::string> & keys)
+{
+    try
+    {
+        return context.at(keys).as_array();
+    } catch(const std::out_of_range& e) {
+        std::stringstream ss;
+        ss << "ez::temp::render: array not found:\"" << boost::algorithm::join(keys, ".") << "\"" << std::endl;
+        throw renderer::render_exception(ss.str().c_str());
+    } catch(const bad_node_access& e) {
+        std::stringstream ss;
+        ss << "ez::temp::render: \"" << boost::algorithm::join(keys, ".") << "\" is not an array" << std::endl;
+        throw renderer::render_exception(ss.str().c_str());
+    }
+}
+
+const node & renderer::value_at(const scope & context, const std::vector<std::string> & keys)
+{
+    try
+    {
+        return context.at(keys);
+    } catch(const std::out_of_range&) {
+        std::stringstream ss;
+        ss << "ez::temp::render: variable not found: \"" << boost::algorithm::join(keys, ".") << "\"";
+        throw renderer::render_exception(ss.str().c_str());
+    } catch(const bad_node_access& e) {
+        std::stringstream ss;
+        ss << "ez::temp::render: \"" << boost::algorithm::join(keys, ".") << "\": " << e.what();
+        throw renderer::render_exception(ss.str().c_str());
+    }
+}
+
+const render_function & renderer::function(const std::string & name)
+{
+    const render_function * function = m_functions.find(name);
+    if(!function)
+    {
+        std::stringstream ss;
+        ss << "ez::temp::render: unknown function: \"" << name << "\"";
+        throw renderer::render_exception(ss.str().c_str());
+    }
+    return *function;
 }
 
 std::string renderer::render(const std::string & input, const std::string & context)
@@ -576,6 +971,11 @@ std::string renderer::render(const std::string & input, const std::string & cont
     return render(input, dict::from_json(context));
 }
 
+void renderer::render(const std::string & input, const std::string & context, output_sink & output)
+{
+    render(compile(input), dict::from_json(context), output);
+}
+
 std::string renderer::render(const std::string & input, const dict & context)
 {
     return render(renderer::compile(input), context);
@@ -587,120 +987,502 @@ std::string renderer::render_file(const std::string & input, const std::string &
     return render(compile_file(input), dict::from_json(context));
 }
 
-int process_tokens(const compiled_template & toks, std::string & output, const dict & context, int ii_start, bool break_on_endfor, const dict & parent_loop_ctx)
+void renderer::render_file(const std::string & input, const std::string & context, output_sink & output)
 {
-    bool loop_done = false;
-    int ii;
-    int ii_last = ii_start;
+    render(compile_file(input), dict::from_json(context), output);
+}
+
+// --------------------------------------------
+// parallel loops
+//
 
-    for(ii = ii_start; ii < toks.size(); ++ii)
+/**
+ * @brief The worker_pool class
+ * Threads shared by all the parallel loops, started on demand.
+ **/
+class worker_pool
+{
+public:
+    static worker_pool & instance()
+    {
+        static worker_pool pool;
+        return pool;
+    }
+
+    ~worker_pool()
     {
-        switch(toks[ii]->token_type())
         {
-        case token::type::section:
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for(std::thread & thread: m_threads)
+            thread.join();
+    }
+
+    /**
+     * @brief Call @a task(0 .. count - 1) on @a threads threads, the caller included.
+     * Returns once every task is done.
+     **/
+    void run(std::size_t count, unsigned threads, const std::function<void(std::size_t)> & task)
+    {
+        struct batch
+        {
+            std::atomic<std::size_t> next{0};
+            std::size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto work = std::make_shared<batch>();
+        const std::function<void(std::size_t)> * job = &task;
+
+        // helpers may only start once the caller took every task: they touch nothing but the batch then
+        auto drain = [work, job, count]() {
+            std::size_t ran = 0;
+            for(std::size_t index; (index = work->next++) < count; ++ran)
+                (*job)(index);
+            if(ran)
             {
-                std::shared_ptr<section_token> open_sec = std::dynamic_pointer_cast<section_token>(toks[ii]);
-                if(open_sec->params()[0] == "for")
-                {
-                    // process the for loop
-                    dict for_context = context;
-                    std::vector<std::string> container_id = split(open_sec->params()[3], '.');
+                std::lock_guard<std::mutex> lock(work->mutex);
+                work->done += ran;
+                if(work->done == count)
+                    work->finished.notify_all();
+            }
+        };
 
-                    try
-                    {
-                        node tmp_node = for_context.at(container_id[0]);
-                        for (int ii = 1; ii < container_id.size(); ++ii)
-                        {
-                            std::map<const std::string, node> d = boost::get<std::map<const std::string, node>>(tmp_node);
-                            tmp_node = d.at(container_id[ii]);
-                        }
-
-                        ez::temp::array & array = boost::get<std::vector<node>>(tmp_node);
-                        int index = 0;
-                        int size = array.size();
-                        dict loop_context = dict();
-                        loop_context["length"] = size;
-                        loop_context["parent"] = parent_loop_ctx;
-                        for(const node & _node: array)
-                        {
-                            loop_context["index"] = index + 1;
-                            loop_context["index0"] = index;
-                            loop_context["first"] = index == 0;
-                            loop_context["last"] = index == size - 1;
-                            loop_context["revindex"] = size - index;
-                            loop_context["revindex0"] = size - index - 1;
-                            for_context["loop"] = loop_context;
-                            for_context[open_sec->params()[1]] = _node;
-
-                            ++index;
-                            ii_last = process_tokens(toks, output, for_context, ii + 1, true, loop_context);
-                        }
-                        ii = ii_last;
-                    } catch(const std::out_of_range& e) {
-                        std::stringstream ss;
-                        ss << "ez::temp::render: array not found:\"" << open_sec->params()[3] << "\"" << std::endl;
-                        throw renderer::render_exception(ss.str().c_str());
-                    } catch(const boost::bad_get& e) {
-                        std::stringstream ss;
-                        ss << "ez::temp::render: \"" << open_sec->params()[3] << "\" is not an array" << std::endl;
-                        throw renderer::render_exception(ss.str().c_str());
-                    }
+        unsigned helpers = static_cast<unsigned>(std::min<std::size_t>(threads, count)) - 1;
+        if(helpers)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while(m_threads.size() < helpers)
+                m_threads.emplace_back([this]() { work_loop(); });
+            for(unsigned ii = 0; ii < helpers; ++ii)
+                m_jobs.emplace_back(drain);
+        }
+        m_wake.notify_all();
 
-                }
-                else if(open_sec->params()[0] == "endfor")
-                {
-                    ii_last = ii;
-                    loop_done = true;
-                    return ii_last;
-                }
-                else if(open_sec->params()[0] == "if")
+        drain();
+        std::unique_lock<std::mutex> lock(work->mutex);
+        work->finished.wait(lock, [&work, count]() { return work->done == count; });
+    }
+
+private:
+    worker_pool() {}
+
+    void work_loop()
+    {
+        for(;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+                if(m_jobs.empty())
+                    return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_jobs;
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+};
+
+template <bool Profiled = false>
+static void process_tokens(const compiled_template & prog, output_sink & output, const scope & context, int ii_start, int ii_end,
+                           const render_options * options);
+
+/**
+ * @brief The locked_resource class
+ * The memory resource of a render, shared with the parallel loop workers:
+ * its use is serialized, as memory resources are not thread safe.
+ **/
+class locked_resource: public std::pmr::memory_resource
+{
+public:
+    locked_resource(std::pmr::memory_resource * upstream): m_upstream(upstream) {}
+
+private:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void * data, std::size_t bytes, std::size_t alignment) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_upstream->deallocate(data, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource * m_upstream;
+    std::mutex m_mutex;
+};
+
+/**
+ * @brief Render the body of the loop at @a ii over @a array in chunks on the
+ * worker pool, each into its own buffer, then write them out in order.
+ * @return false if the loop is too short to be split.
+ **/
+static bool process_parallel_loop(const compiled_template & prog, output_sink & output, const scope & context, int ii,
+                                  const array & items, const render_options & options)
+{
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::size_t min_chunk = std::max<std::size_t>(1, options.min_chunk);
+    // a few chunks per thread even out the uneven ones
+    std::size_t chunks = std::min<std::size_t>(std::size_t(threads) * 4, items.size() / min_chunk);
+    if(threads < 2 || chunks < 2)
+        return false;
+
+    const token & tok = prog[ii];
+    const std::string & name = tok.section().params()[1];
+    std::vector<std::string> buffers(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+    worker_pool::instance().run(chunks, threads, [&](std::size_t chunk) {
+        std::size_t begin = items.size() * chunk / chunks;
+        std::size_t end = items.size() * (chunk + 1) / chunks;
+        try
+        {
+            // the locked resource of the render, if any
+            const memory_scope memory(options.memory);
+            string_sink sink(buffers[chunk]);
+            scope for_context(context, name, items.size(), begin);
+            for(std::size_t index = begin; index < end; ++index)
+            {
+                for_context.next(items[index]);
+                process_tokens(prog, sink, for_context, ii + 1, tok.jump(), nullptr);
+            }
+            sink.flush();
+        }
+        catch(...)
+        {
+            errors[chunk] = std::current_exception();
+        }
+    });
+
+    for(std::size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        if(errors[chunk])
+            std::rethrow_exception(errors[chunk]);
+        output.write(buffers[chunk]);
+    }
+    return true;
+}
+
+// --------------------------------------------
+// profiling
+//
+
+/**
+ * @brief The counting_sink class
+ * Counts the bytes written through it to another sink.
+ **/
+class counting_sink : public output_sink
+{
+public:
+    counting_sink(output_sink & output): m_output(output) {}
+    using output_sink::write;
+    void write(const char * data, std::size_t size) override { m_output.write(data, size); m_bytes += size; }
+    inline std::uint64_t bytes() const { return m_bytes; }
+private:
+    output_sink & m_output;
+    std::uint64_t m_bytes = 0;
+};
+
+/**
+ * @brief The token_probe class
+ * Adds the time spent and the bytes written until it goes out of scope to
+ * the counters of a token. Does nothing unless @a Profiled.
+ **/
+template <bool Profiled>
+class token_probe
+{
+public:
+    token_probe(const render_options *, int, const output_sink &) {}
+};
+
+template <>
+class token_probe<true>
+{
+public:
+    token_probe(const render_options * options, int index, const counting_sink & output):
+        m_counters(options->profile->at(index)),
+        m_output(output),
+        m_bytes(output.bytes()),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+    ~token_probe()
+    {
+        ++m_counters.calls;
+        m_counters.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+        m_counters.bytes += m_output.bytes() - m_bytes;
+    }
+private:
+    render_profile::counters & m_counters;
+    const counting_sink & m_output;
+    std::uint64_t m_bytes;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * @brief Process tokens from @a ii_start to @a ii_end.
+ * When @a Profiled, @a options has a profile, getting the counters of each
+ * token, and loops are not split.
+ * @param options   Parallel loop settings, null inside a parallel chunk.
+ **/
+template <bool Profiled>
+static void process_tokens(const compiled_template & prog, output_sink & output_base, const scope & context, int ii_start, int ii_end,
+                           const render_options * options)
+{
+    std::conditional_t<Profiled, counting_sink, output_sink &> output(output_base);
+    for(int ii = ii_start; ii < ii_end; ++ii)
+    {
+        const token & tok = prog[ii];
+        token_probe<Profiled> probe(options, ii, output);
+        switch(tok.op())
+        {
+        case opcode::for_loop:
+            {
+                const section_token & open_sec = tok.section();
+                if(std::unique_ptr<sequence> items = context.iterate(open_sec.loop_keys()))
                 {
-                    int ii_param = 1;
-                    bool check_request = true;
-                    if(open_sec->params()[1] == "not")
+                    // produced one at a time: never split
+                    scope for_context(context, open_sec.params()[1], static_cast<int>(items->size()));
+                    node item;
+                    while(items->next(item))
                     {
-                        check_request = false;
-                        ii_param++;
+                        for_context.next(item);
+                        process_tokens<Profiled>(prog, output, for_context, ii + 1, tok.jump(), options);
                     }
+                    ii = tok.jump();
+                    break;
+                }
 
-                    std::vector<std::string> keys = split(open_sec->params()[ii_param], '.');
+                // process the for loop
+                const ez::temp::array * array = &renderer::loop_array(context, open_sec.loop_keys());
 
-                    bool result = boost::apply_visitor(bool_check_node_visitor(keys), context.at(keys.at(0)));
-                    if(result != check_request)
+                if(!(!Profiled && options && (options->parallel || open_sec.is_parallel())
+                     && process_parallel_loop(prog, output, context, ii, *array, *options)))
+                {
+                    scope for_context(context, open_sec.params()[1], array->size());
+                    for(const node & _node: *array)
                     {
-                        // jump to else section
-                        std::shared_ptr<section_token> tmp_sec;
-                        int endif_index = get_next_section(toks, "endif", tmp_sec, ii);
-                        int else_index = get_next_section(toks, "else", tmp_sec, ii);
-                        if(else_index != -1 && else_index < endif_index)
-                            ii = else_index;
-                        else ii = endif_index;
+                        for_context.next(_node);
+                        process_tokens<Profiled>(prog, output, for_context, ii + 1, tok.jump(), options);
                     }
                 }
-                else if(open_sec->params()[0] == "else")
+                ii = tok.jump();
+            }
+            break;
+        case opcode::if_test:
+            {
+                if(!tok.section().condition().test(context))
                 {
-                    // jump to endif section
-                    std::shared_ptr<section_token> endif_sec;
-                    ii = get_next_section(toks, "endif", endif_sec, ii);
+                    // jump to else (or endif) section
+                    ii = tok.jump();
                 }
             }
             break;
-        default:
+        case opcode::else_branch:
+            // jump to endif section
+            ii = tok.jump();
+            break;
+        case opcode::cache:
             {
-                output += toks[ii]->render(context);
+                const section_token & open_sec = tok.section();
+                std::string key;
+                string_sink key_sink(key);
+                open_sec.key().render(context, key_sink);
+                if(std::shared_ptr<const std::string> fragment = renderer::cache().find(key))
+                {
+                    output.write(*fragment);
+                }
+                else
+                {
+                    std::string rendered;
+                    string_sink sink(rendered);
+                    process_tokens<Profiled>(prog, sink, context, ii + 1, tok.jump(), options);
+                    output.write(rendered);
+                    renderer::cache().insert(key, std::move(rendered), open_sec.ttl());
+                }
+                ii = tok.jump();
             }
+            break;
+        case opcode::text:
+            tok.text().render(context, output);
+            break;
+        case opcode::render:
+            tok.render().render(context, output);
+            break;
+        default:
+            break;
         }
     }
-    return ii_last;
 }
 
-std::string renderer::render(const compiled_template & toks, const dict & context)
+std::string renderer::render(const compiled_template & prog, const dict & context)
 {
     std::string output;
-    process_tokens(toks, output, context, 0, false, dict());
+    string_sink sink(output);
+    render(prog, context, sink);
     return output;
 }
 
+void renderer::render(const compiled_template & prog, const dict & context, output_sink & output)
+{
+    render(prog, context, output, render_options());
+}
+
+void renderer::render(const compiled_template & prog, const dict & context, output_sink & output, const render_options & options)
+{
+    // the parallel loop workers get the resource through a lock, which must outlive what they allocate
+    std::optional<memory_scope> memory;
+    std::optional<locked_resource> locked;
+    std::optional<render_options> with_locked;
+    const render_options * used = &options;
+    if(options.memory)
+    {
+        memory.emplace(options.memory);
+        locked.emplace(options.memory);
+        with_locked.emplace(options);
+        with_locked->memory = &*locked;
+        used = &*with_locked;
+    }
+    std::optional<provided_values> provided;
+    if(options.provider)
+        provided.emplace(*options.provider);
+    const scope root(context, provided ? &*provided : nullptr);
+    if(options.profile)
+    {
+        if(&options.profile->program() != &prog)
+            throw render_exception("ez::temp::render: the profile is for another template");
+        process_tokens<true>(prog, output, root, 0, prog.size(), used);
+    }
+    else
+    {
+        process_tokens(prog, output, root, 0, prog.size(), used);
+    }
+    output.flush();
+}
+
+void renderer::render(const compiled_template & prog, const dict & context, std::ostream & output)
+{
+    ostream_sink sink(output);
+    render(prog, context, sink);
+}
+
+
+// --------------------------------------------
+// batch rendering
+//
+
+/**
+ * @brief Render @a prog for contexts 0 .. count - 1, @a with_context(index, f)
+ * calling f with the context @a index.
+ **/
+template <typename WithContext>
+static void process_batch(const compiled_template & prog, std::size_t count, WithContext with_context,
+                          const batch_callback & callback, const batch_options & options)
+{
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    // a few slices per thread even out the uneven contexts, windows bound the buffered outputs
+    const std::size_t slices = std::size_t(threads) * 4;
+    const std::size_t window = options.ordered ? slices * 16 : count;
+
+    std::vector<std::string> buffers(options.ordered ? std::min(window, count) : slices);
+    std::vector<std::exception_ptr> errors(slices);
+    std::vector<std::size_t> failed(slices);
+    for(std::size_t first = 0; first < count; first += window)
+    {
+        const std::size_t size = std::min(window, count - first);
+        const std::size_t tasks = std::min(slices, size);
+        worker_pool::instance().run(tasks, threads, [&](std::size_t task) {
+            std::size_t index = first + size * task / tasks;
+            const std::size_t end = first + size * (task + 1) / tasks;
+            try
+            {
+                for(; index < end; ++index)
+                {
+                    std::string & buffer = options.ordered ? buffers[index - first] : buffers[task];
+                    buffer.clear();
+                    string_sink sink(buffer);
+                    with_context(index, [&](const dict & context) {
+                        process_tokens(prog, sink, scope(context), 0, prog.size(), nullptr);
+                    });
+                    sink.flush();
+                    if(!options.ordered)
+                        callback(index, buffer);
+                }
+            }
+            catch(...)
+            {
+                errors[task] = std::current_exception();
+                failed[task] = index;
+            }
+        });
+
+        for(std::size_t task = 0; task < tasks; ++task)
+        {
+            if(!errors[task])
+                continue;
+            try
+            {
+                std::rethrow_exception(errors[task]);
+            }
+            catch(const std::exception & e)
+            {
+                std::stringstream ss;
+                ss << "ez::temp::render_batch: context " << failed[task] << ": " << e.what();
+                throw renderer::render_exception(ss.str().c_str());
+            }
+        }
+        if(options.ordered)
+        {
+            for(std::size_t index = 0; index < size; ++index)
+                callback(first + index, buffers[index]);
+        }
+    }
+}
+
+void renderer::render_batch(const compiled_template & prog, const std::vector<dict> & contexts,
+                            const batch_callback & callback, const batch_options & options)
+{
+    process_batch(prog, contexts.size(), [&contexts](std::size_t index, auto && render) {
+        render(contexts[index]);
+    }, callback, options);
+}
+
+void renderer::render_batch(const compiled_template & prog, const std::vector<std::string> & contexts,
+                            const batch_callback & callback, const batch_options & options)
+{
+    process_batch(prog, contexts.size(), [&contexts](std::size_t index, auto && render) {
+        render(dict::from_json(contexts[index]));
+    }, callback, options);
+}
+
+std::vector<std::string> renderer::render_batch(const compiled_template & prog, const std::vector<dict> & contexts,
+                                                const batch_options & options)
+{
+    std::vector<std::string> outputs(contexts.size());
+    batch_options unordered = options;
+    unordered.ordered = false;
+    render_batch(prog, contexts, [&outputs](std::size_t index, std::string_view output) {
+        outputs[index] = output;
+    }, unordered);
+    return outputs;
+}
 
 // -----------------------------------------
 // renderer functions registration
@@ -708,15 +1490,15 @@ std::string renderer::render(const compiled_template & toks, const dict & contex
 
 static bool register_functions()
 {
-    renderer::add_function("date",[](array args) -> std::string{
+    renderer::add_function("date",[](const array & args) -> std::string{
        namespace pt = boost::posix_time;
        namespace gr = boost::gregorian;
        pt::ptime todayUtc(gr::day_clock::universal_day(), pt::second_clock::universal_time().time_of_day());
        return pt::to_simple_string(todayUtc);
     });
 
-    renderer::add_function("toupper",[](array args) -> std::string{
-        std::string str = boost::get<std::string>(args[0]);
+    renderer::add_function("toupper",[](const array & args) -> std::string{
+        std::string str(args.at(0).as_string());
         boost::to_upper(str);
         return str;
     });
@@ -0,0 +1,82 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Renders a template over many contexts in batches, ordered or not and with
+ * several thread counts, and checks every output against renderer::render.
+ **/
+int main()
+{
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(
+        "Dear {{ name }},\n{% for item in items %}{{ loop.index }}. {{ item }}{% if loop.last %}.{% else %},{% endif %}\n{% endfor %}");
+
+    std::vector<ez::temp::dict> contexts;
+    std::vector<std::string> json;
+    for(int ii = 0; ii < 3000; ++ii)
+    {
+        std::string items;
+        for(int jj = 0; jj < ii % 5; ++jj)
+            items += (jj ? ", \"item " : "\"item ") + std::to_string(jj) + "\"";
+        json.push_back("{ \"name\" : \"user " + std::to_string(ii) + "\", \"items\" : [" + items + "] }");
+        contexts.push_back(ez::temp::dict::from_json(json.back()));
+    }
+
+    std::vector<std::string> expected;
+    for(const ez::temp::dict & context: contexts)
+        expected.push_back(ez::temp::renderer::render(tmpl, context));
+
+    int failures = 0;
+    auto check = [&](const std::string & what, const std::vector<std::string> & outputs) {
+        if(outputs != expected)
+        {
+            std::cerr << what << " differs" << std::endl;
+            ++failures;
+        }
+    };
+
+    for(unsigned threads: {1u, 2u, 5u})
+    {
+        ez::temp::batch_options options;
+        options.threads = threads;
+        check("vector, " + std::to_string(threads) + " threads", ez::temp::renderer::render_batch(tmpl, contexts, options));
+
+        // in order from the calling thread
+        std::vector<std::string> outputs;
+        ez::temp::renderer::render_batch(tmpl, json, [&outputs](std::size_t index, std::string_view output) {
+            if(index == outputs.size())
+                outputs.emplace_back(output);
+        }, options);
+        check("ordered Json, " + std::to_string(threads) + " threads", outputs);
+
+        // from the workers, in any order
+        outputs.assign(json.size(), std::string());
+        options.ordered = false;
+        ez::temp::renderer::render_batch(tmpl, json, [&outputs](std::size_t index, std::string_view output) {
+            outputs[index] = output;
+        }, options);
+        check("unordered Json, " + std::to_string(threads) + " threads", outputs);
+    }
+
+    // the failing context is named
+    json[1234] = "{ \"name\" : \"broken\" }";
+    try
+    {
+        ez::temp::renderer::render_batch(tmpl, json, [](std::size_t, std::string_view) {});
+        std::cerr << "missing error" << std::endl;
+        ++failures;
+    }
+    catch(const ez::temp::renderer::render_exception & e)
+    {
+        if(std::string(e.what()).find("context 1234:") == std::string::npos)
+        {
+            std::cerr << "unexpected error: " << e.what() << std::endl;
+            ++failures;
+        }
+    }
+
+    std::cout << contexts.size() << " contexts, " << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
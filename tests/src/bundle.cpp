@@ -0,0 +1,86 @@
+#include <eztemp.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+static void write_file(const boost::filesystem::path & path, const std::string & text)
+{
+    std::ofstream file(path.string(), std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+/**
+ * Checks that a directory bundled to an archive renders like its templates,
+ * with its extends graph.
+ **/
+int main()
+{
+    namespace fs = boost::filesystem;
+
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("eztemp-bundle-%%%%-%%%%");
+    fs::create_directories(dir / "mail");
+    write_file(dir / "base.txt.ez", "<{% block body %}base{% endblock %}>{% block footer %} -- {{ sender }}{% endblock %}\n");
+    write_file(dir / "mail" / "layout.txt.ez", "{% extends base.txt %}{% block body %}Dear {{ toupper(name) }}{% endblock %}");
+    write_file(dir / "mail" / "welcome.txt.ez", "{% extends layout.txt %}{% block footer %}welcome{% endblock %}");
+    write_file(dir / "mail" / "bye.txt.ez", "{% extends layout.txt %}{% block footer %}{% if 1 < 2 %}bye{% endif %}{% endblock %}");
+    write_file(dir / "readme.txt", "not a template");
+
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"name\" : \"bob\", \"sender\" : \"me\" }");
+    ez::temp::environment env({dir.string()});
+
+    ez::temp::template_bundle bundle = ez::temp::template_bundle::compile_directory(dir.string());
+    expect(bundle.names() == std::vector<std::string>({"base.txt.ez", "mail/bye.txt.ez", "mail/layout.txt.ez", "mail/welcome.txt.ez"}),
+           "names");
+    expect(bundle.dependencies("mail/welcome.txt.ez") == std::vector<std::string>({"mail/welcome.txt.ez", "mail/layout.txt.ez", "base.txt.ez"}),
+           "extends graph");
+    expect(bundle.dependencies("base.txt.ez").size() == 1, "no base");
+
+    const std::string archive = (dir / "templates.ezb").string();
+    bundle.save(archive);
+    ez::temp::template_bundle loaded = ez::temp::template_bundle::load(archive);
+    expect(loaded.names() == bundle.names(), "loaded names");
+    expect(loaded.dependencies("mail/bye.txt.ez") == bundle.dependencies("mail/bye.txt.ez"), "loaded graph");
+    for(const std::string & name: bundle.names())
+    {
+        const std::string expected = env.render((dir / name).string(), context);
+        expect(bundle.render(name, context) == expected, "compiled: " + name);
+        expect(loaded.render(name, context) == expected, "loaded: " + name);
+    }
+    expect(loaded.render("mail/layout.txt.ez", context) == "<Dear BOB> -- me\n", "output");
+
+    // the texts the templates have in common are stored once
+    std::uintmax_t separate = 0;
+    for(const std::string & name: bundle.names())
+    {
+        const std::string path = (dir / (name + "c")).string();
+        bundle.get_template(name)->save(path);
+        separate += fs::file_size(path);
+    }
+    expect(fs::file_size(archive) < separate, "shared texts");
+
+    try
+    {
+        loaded.get_template("missing.txt.ez");
+        expect(false, "missing template raised");
+    }
+    catch(const ez::temp::renderer::compile_exception &)
+    {
+    }
+    try
+    {
+        ez::temp::template_bundle::load((dir / "mail" / "welcome.txt.ezc").string());
+        expect(false, "not a bundle raised");
+    }
+    catch(const ez::temp::renderer::compile_exception &)
+    {
+    }
+
+    fs::remove_all(dir);
+
+    return report();
+}
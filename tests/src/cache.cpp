@@ -0,0 +1,88 @@
+#include <eztemp.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "eztest.h"
+
+/**
+ * Checks the LRU, limits, expiry and statistics of fragment_cache, and the
+ * {% cache %} sections rendering through it.
+ **/
+int main()
+{
+    // LRU order and entry limit
+    ez::temp::fragment_cache cache(2, 100);
+    cache.insert("a", "1");
+    cache.insert("b", "2");
+    expect(cache.find("a") && *cache.find("a") == "1", "find a");
+    cache.insert("c", "3");
+    expect(!cache.find("b"), "b evicted as least recently used");
+    expect(cache.find("a") && cache.find("c"), "a and c kept");
+    ez::temp::fragment_cache::statistics stats = cache.stats();
+    expect(stats.evictions == 1 && stats.entries == 2 && stats.bytes == 2, "entry limit statistics");
+    expect(stats.hits == 4 && stats.misses == 1, "hit and miss counts");
+
+    // size limit, oversized fragments, replacement and invalidation
+    cache.insert("big", std::string(101, 'x'));
+    expect(!cache.find("big") && cache.stats().entries == 2, "oversized fragment not stored");
+    cache.insert("a", std::string(60, 'a'));
+    cache.insert("c", std::string(60, 'c'));
+    expect(cache.stats().bytes == 60 && cache.stats().entries == 1, "size limit evicts");
+    expect(cache.invalidate("c") && !cache.invalidate("c") && cache.stats().entries == 0, "invalidate");
+
+    // expiry
+    cache.reset_statistics();
+    cache.insert("short", "s", 0.01);
+    cache.insert("long", "l", 60);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    expect(!cache.find("short") && cache.find("long"), "short expired, long kept");
+    expect(cache.stats().expirations == 1, "expiration count");
+    cache.set_limits(0, 100);
+    expect(cache.stats().entries == 0, "limits lowered");
+
+    // cache sections
+    ez::temp::fragment_cache & shared = ez::temp::renderer::cache();
+    shared.clear();
+    shared.reset_statistics();
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(
+        "{% for item in items %}{% cache 'list-' + lang 60 %}{% for x in items %}{{ x }}{% endfor %}{% endcache %};{% endfor %}");
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"lang\" : \"en\", \"items\" : [1, 2, 3] }");
+    expect(ez::temp::renderer::render(tmpl, context) == "123;123;123;", "section output");
+    stats = shared.stats();
+    expect(stats.misses == 1 && stats.hits == 2 && stats.entries == 1, "section rendered once");
+
+    // the cached fragment is served until invalidated, even if the context changes
+    context["items"] = ez::temp::array{ez::temp::node(4)};
+    expect(ez::temp::renderer::render(tmpl, context) == "123;", "stale fragment served");
+    expect(shared.invalidate("list-en"), "invalidate by key");
+    expect(ez::temp::renderer::render(tmpl, context) == "4;", "fragment rendered again");
+
+    // keys follow the context
+    context["lang"] = "fr";
+    context["items"] = ez::temp::array{ez::temp::node(5)};
+    expect(ez::temp::renderer::render(tmpl, context) == "5;" && shared.stats().entries == 2, "key from the context");
+
+    // a trailing number is the ttl only after a whole key
+    const std::pair<const char *, std::pair<const char *, double>> sections[] = {
+        {"{% cache a 10 %}{% endcache %}", {"a", 10}},
+        {"{% cache a + 10 %}{% endcache %}", {"a + 10", 0}},
+        {"{% cache 'k-' + a * 2 30 %}{% endcache %}", {"'k-' + a * 2", 30}},
+        {"{% cache a and 2 %}{% endcache %}", {"a and 2", 0}},
+        {"{% cache 5 %}{% endcache %}", {"5", 0}},
+    };
+    for(const auto & section: sections)
+    {
+        const ez::temp::compiled_template prog = ez::temp::renderer::compile(section.first, "", false);
+        const ez::temp::section_token & open = prog[0].section();
+        expect(open.key().source() == section.second.first && open.ttl() == section.second.second,
+               std::string(section.first) + ": key \"" + open.key().source() + "\", ttl " + std::to_string(open.ttl()));
+    }
+    context["a"] = 1;
+    expect(ez::temp::renderer::render(ez::temp::renderer::compile("{% cache 'n-' + a * 10 %}{{ a }}{% endcache %}"), context) == "1"
+           && shared.find("n-10"), "key ending with a number");
+
+    return report();
+}
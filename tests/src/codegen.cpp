@@ -0,0 +1,52 @@
+#include <eztemp.h>
+
+#include "index.html.h"
+
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * Renders a template through the C++ code generated by eztemp-cc --emit-cpp
+ * and checks it against the renderer output, on a fragment cache miss then
+ * a hit, and the error raised for a missing variable.
+ **/
+int main(int argc, char ** argv)
+{
+    ez::temp::dict context = ez::temp::dict::from_json(
+        "{ \"who\" : \"world\", \"list\" : [\"a\", \"b\", \"c\"] }");
+    ez::temp::fragment_cache & cache = ez::temp::renderer::cache();
+
+    // the generated code first, on an empty cache
+    cache.clear();
+    cache.reset_statistics();
+    const std::string missed = tests::render_index_html(context);
+    expect(cache.stats().misses == 1 && cache.stats().hits == 0, "generated code cache miss");
+    const std::string hit = tests::render_index_html(context);
+    expect(cache.stats().misses == 1 && cache.stats().hits == 1, "generated code cache hit");
+
+    cache.clear();
+    const std::string expected = ez::temp::renderer::render(
+        ez::temp::renderer::compile_file(argc > 1 ? argv[1] : "templates/index.html.ez"), context);
+    expect(expected.find("Cached for world.") != std::string::npos, "cached section rendered");
+    expect(missed == expected, "generated code output on a miss differs, expected:\n" + expected + "\ngot:\n" + missed);
+    expect(hit == expected, "generated code output on a hit differs, expected:\n" + expected + "\ngot:\n" + hit);
+
+    // a missing variable raises the same error as the renderer
+    try
+    {
+        tests::render_index_html(ez::temp::dict::from_json("{ \"list\" : [] }"));
+        expect(false, "missing variable raised");
+    }
+    catch(const ez::temp::renderer::render_exception & e)
+    {
+        expect(std::string(e.what()).find("\"who\"") != std::string::npos, std::string("missing variable: ") + e.what());
+    }
+    catch(const std::exception & e)
+    {
+        expect(false, std::string("missing variable raised ") + e.what() + ", not a render_exception");
+    }
+
+    return report();
+}
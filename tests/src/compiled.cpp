@@ -0,0 +1,99 @@
+#include <eztemp.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+static void write_file(const std::string & path, const std::string & text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+/**
+ * @brief Whether loading @a path fails with a compile_exception.
+ **/
+static bool load_fails(const std::string & path)
+{
+    try
+    {
+        ez::temp::compiled_template::load(path);
+        return false;
+    }
+    catch(const ez::temp::renderer::compile_exception &)
+    {
+        return true;
+    }
+}
+
+/**
+ * Checks that templates saved in the .ezc format render the same once
+ * loaded, and that stale or invalid files are refused.
+ **/
+int main()
+{
+    namespace fs = boost::filesystem;
+
+    ez::temp::dict context = ez::temp::dict::from_json(
+        "{ \"name\" : \"world\", \"items\" : [1, 2, 3], \"on\" : true, \"user\" : { \"first-name\" : \"Bob\" } }");
+
+    // every kind of token
+    const std::string input =
+        "Hello {{ toupper(name) }} {{ user.first-name }} {{ 6 * 7 }}!\n"
+        "{% for i in items parallel %}{{ loop.index }}:{{ i * 2.5 }}{% if not loop.last %}, {% else %}.{% endif %}{% endfor %}\n"
+        "{% if on and name != 'bob' %}on{% else %}off{% endif %} {% if not on %}never{% endif %}\n"
+        "{% cache 'ezc-' + name 60 %}[{{ name + '!' }}]{% endcache %}\n";
+    ez::temp::compiled_template prog = ez::temp::renderer::compile(input);
+    prog.save("compiled.ezc");
+    ez::temp::compiled_template loaded = ez::temp::compiled_template::load("compiled.ezc");
+    expect(loaded.size() == prog.size(), "same tokens");
+    expect(loaded.removed_tokens() == prog.removed_tokens(), "same removed tokens");
+    expect(ez::temp::renderer::render(loaded, context) == ez::temp::renderer::render(prog, context), "same output");
+    bool positions = false;
+    for(const ez::temp::token & tok: loaded)
+        positions |= tok.position() != nullptr;
+    expect(!positions, "no positions");
+
+    // extends chain, resolved when saved
+    ez::temp::compiled_template page = ez::temp::renderer::compile_file("templates/index.html.ez");
+    page.save("index.html.ezc");
+    ez::temp::dict page_context = ez::temp::dict::from_json("{ \"who\" : \"w\", \"list\" : [\"a\", \"b\", \"c\"] }");
+    expect(ez::temp::renderer::render(ez::temp::compiled_template::load("index.html.ezc"), page_context)
+           == ez::temp::renderer::render(page, page_context), "layout output");
+
+    // a changed template makes its .ezc stale
+    write_file("stale.txt.ez", "Hello {{ name }}");
+    ez::temp::renderer::compile_file("stale.txt.ez").save("stale.txt.ezc");
+    expect(!load_fails("stale.txt.ezc"), "fresh");
+    write_file("stale.txt.ez", "Hello {{ name }} !");
+    try
+    {
+        ez::temp::compiled_template::load("stale.txt.ezc");
+        expect(false, "stale raised");
+    }
+    catch(const ez::temp::renderer::stale_exception & e)
+    {
+        expect(fs::equivalent(e.source(), "stale.txt.ez"), "stale source");
+    }
+    expect(ez::temp::renderer::render(ez::temp::compiled_template::load("stale.txt.ezc", false), context) == "Hello world",
+           "unchecked stale");
+
+    // invalid files
+    std::ifstream saved("compiled.ezc", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+    for(std::size_t size: {std::size_t(0), std::size_t(3), std::size_t(12), bytes.size() / 2, bytes.size() - 1})
+    {
+        write_file("invalid.ezc", bytes.substr(0, size));
+        expect(load_fails("invalid.ezc"), "truncated at " + std::to_string(size));
+    }
+    write_file("invalid.ezc", "EZTX" + bytes.substr(4));
+    expect(load_fails("invalid.ezc"), "magic");
+    write_file("invalid.ezc", bytes + "x");
+    expect(load_fails("invalid.ezc"), "trailing data");
+
+    return report();
+}
@@ -0,0 +1,100 @@
+#include <eztemp.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+static void write_file(const boost::filesystem::path & path, const std::string & text)
+{
+    std::ofstream file(path.string(), std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+/**
+ * @brief Checks the hits and misses since the last call.
+ **/
+class counter
+{
+public:
+    counter(const ez::temp::environment & env): m_env(env) {}
+
+    void expect_counts(std::size_t misses, std::size_t hits, const std::string & what)
+    {
+        expect(m_env.misses() - m_misses == misses && m_env.hits() - m_hits == hits,
+               what + ": " + std::to_string(m_env.misses() - m_misses) + " misses, "
+               + std::to_string(m_env.hits() - m_hits) + " hits");
+        m_misses = m_env.misses();
+        m_hits = m_env.hits();
+    }
+
+private:
+    const ez::temp::environment & m_env;
+    std::size_t m_misses = 0;
+    std::size_t m_hits = 0;
+};
+
+/**
+ * Checks that an environment compiles a template once, and again when it,
+ * or the layout it extends, changes on disk or is invalidated.
+ **/
+int main()
+{
+    namespace fs = boost::filesystem;
+
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("eztemp-env-%%%%-%%%%");
+    fs::create_directories(dir);
+    write_file(dir / "single.txt.ez", "single {{ a }}");
+    write_file(dir / "layout.txt.ez", "L[{% block b %}x{% endblock %}]");
+    write_file(dir / "page.txt.ez", "{% extends layout.txt %}{% block b %}{{ a }}{% endblock %}");
+
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"a\" : 1 }");
+    ez::temp::environment env({dir.string()});
+    counter counts(env);
+
+    expect(env.render("single.txt.ez", context) == "single 1", "single output");
+    counts.expect_counts(1, 0, "single compiled");
+    expect(env.render("single.txt.ez", context) == "single 1", "single cached output");
+    counts.expect_counts(0, 1, "single cached");
+
+    // a template and its layout count one each
+    expect(env.render("page.txt.ez", context) == "L[1]", "page output");
+    counts.expect_counts(2, 0, "page compiled");
+    expect(env.render("page.txt.ez", context) == "L[1]", "page cached output");
+    counts.expect_counts(0, 2, "page cached");
+
+    // a changed size, then a changed modification time
+    write_file(dir / "layout.txt.ez", "M[{% block b %}x{% endblock %}]!");
+    expect(env.render("page.txt.ez", context) == "M[1]!", "layout reloaded output");
+    // the layout, then the page, which gets the new layout from the cache
+    counts.expect_counts(2, 1, "layout reloaded");
+    fs::last_write_time(dir / "page.txt.ez", fs::last_write_time(dir / "page.txt.ez") - 10);
+    expect(env.render("page.txt.ez", context) == "M[1]!", "page reloaded output");
+    counts.expect_counts(1, 1, "page reloaded");
+
+    // invalidated
+    env.invalidate("page.txt.ez");
+    env.render("page.txt.ez", context);
+    counts.expect_counts(1, 1, "page invalidated");
+    env.invalidate("layout.txt.ez");
+    env.render("page.txt.ez", context);
+    counts.expect_counts(2, 1, "layout invalidated");
+    env.clear();
+    env.render("page.txt.ez", context);
+    counts.expect_counts(2, 0, "cleared");
+
+    // changes not checked
+    env.set_auto_reload(false);
+    write_file(dir / "page.txt.ez", "{% extends layout.txt %}{% block b %}{{ a }}{{ a }}{% endblock %}");
+    expect(env.render("page.txt.ez", context) == "M[1]!", "not reloaded output");
+    counts.expect_counts(0, 2, "not reloaded");
+    env.invalidate("page.txt.ez");
+    expect(env.render("page.txt.ez", context) == "M[11]!", "invalidated output");
+
+    fs::remove_all(dir);
+
+    return report();
+}
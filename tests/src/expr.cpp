@@ -0,0 +1,74 @@
+#include <ezexpr.h>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Checks compiled expressions against their expected values, evaluation from
+ * slots against evaluation from a context, and the reported errors.
+ **/
+int main()
+{
+    ez::temp::dict context;
+    context["a"] = 1;
+    context["b"] = 2.5;
+    context["c"] = 9;
+
+    const double pi = std::acos(-1.0);
+    const std::vector<std::pair<std::string, double>> inputs = {
+        {"a * 2 + b / 3 - sqrt(c) ** 2", 2 + 2.5 / 3 - 9}, {"2**3**2", 512}, {"-2**2", 4}, {"+-a", -1},
+        {"max(a, b) + PI", 2.5 + pi}, {"1e3+.5", 1000.5}, {"1.e2", 100}, {"(1+2)*3", 9}, {"2*-3", -6},
+        {"atan2(1, 1)*4", pi}, {"Abs(-c) / floor(b)", 4.5}, {" a*a - b*b ", 1 - 6.25},
+        {"pow(2, 10) - min(c, 4)", 1020}, {"e * epsilon", std::exp(1.0) * std::numeric_limits<double>::epsilon()},
+    };
+
+    int failures = 0;
+    for(const auto & entry: inputs)
+    {
+        const std::string & input = entry.first;
+        const double expected = entry.second;
+        ez::expr::compiled_expression<double> expr(input);
+        double from_context = expr.evaluate(context);
+        std::vector<double> slots;
+        for(const std::string & name: expr.variables())
+            slots.push_back(ez::expr::eval<double>(name, context));
+        double from_slots = expr.evaluate(slots);
+
+        if(std::abs(from_context - expected) > 1e-12 || from_slots != from_context)
+        {
+            std::cerr << "\"" << input << "\": " << from_context << " / " << from_slots
+                      << ", expected " << expected << std::endl;
+            ++failures;
+        }
+    }
+
+    for(const auto & input: {"1 +", "foo(2)", "a b", "(a", "max(a)", "2 ** ", ""})
+    {
+        try
+        {
+            ez::expr::compiled_expression<double> expr(input);
+            std::cerr << "\"" << input << "\" should not parse" << std::endl;
+            ++failures;
+        }
+        catch(const ez::expr::parse_error &)
+        {
+        }
+    }
+
+    try
+    {
+        ez::expr::eval<double>("a + missing", context);
+        std::cerr << "missing variable not reported" << std::endl;
+        ++failures;
+    }
+    catch(const ez::expr::eval_error &)
+    {
+    }
+
+    std::cout << inputs.size() << " expressions, " << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
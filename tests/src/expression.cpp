@@ -0,0 +1,89 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * Checks template expressions: literals and constants that look like key
+ * paths, and the errors raised for missing or mistyped variables.
+ **/
+int main()
+{
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"a\" : 1, \"user\" : { \"name\" : \"bob\" } }");
+    auto render = [&context](const std::string & input) {
+        return ez::temp::renderer::render(ez::temp::renderer::compile(input), context);
+    };
+
+    // literals and constants are not looked up
+    expect(render("{% if true %}T{% endif %}{% if false %}F{% else %}f{% endif %}") == "Tf", "if literals");
+    expect(render("{{ true }} {{ false }} {{ not false }}") == "true false true", "literal tags");
+    expect(render("{{ pi }}").compare(0, 4, "3.14") == 0, "constant tag: " + render("{{ pi }}"));
+    expect(render("{% if PI %}pi{% endif %}") == "pi", "constant condition");
+    expect(ez::temp::expression::is_key_path("user.name") && !ez::temp::expression::is_key_path("true")
+           && !ez::temp::expression::is_key_path("Pi"), "is_key_path");
+
+    // one truthiness rule for context values and literals
+    ez::temp::dict values = ez::temp::dict::from_json(
+        "{ \"name\" : \"bob\", \"off\" : \"false\", \"empty\" : \"\", \"user\" : { \"admin\" : true }, "
+        "\"none\" : [], \"zero\" : 0, \"nothing\" : null }");
+    const std::pair<const char *, const char *> truths[] = {
+        {"{% if name %}y{% else %}n{% endif %}", "y"},
+        {"{% if 'bob' %}y{% else %}n{% endif %}", "y"},
+        {"{% if not name %}y{% else %}n{% endif %}", "n"},
+        {"{% if name and 1 %}y{% else %}n{% endif %}", "y"},
+        {"{% if off %}y{% else %}n{% endif %}", "n"},
+        {"{% if 'false' %}y{% else %}n{% endif %}", "n"},
+        {"{% if off or 0 %}y{% else %}n{% endif %}", "n"},
+        {"{% if empty %}y{% else %}n{% endif %}", "n"},
+        {"{% if '' or empty %}y{% else %}n{% endif %}", "n"},
+        {"{% if user and user.admin %}y{% else %}n{% endif %}", "y"},
+        {"{% if none or zero or nothing %}y{% else %}n{% endif %}", "n"},
+        {"{% if not none %}y{% else %}n{% endif %}", "y"},
+    };
+    for(const auto & truth: truths)
+    {
+        try
+        {
+            const std::string output = ez::temp::renderer::render(ez::temp::renderer::compile(truth.first), values);
+            expect(output == truth.second, std::string(truth.first) + ": " + output);
+        }
+        catch(const std::exception & e)
+        {
+            expect(false, std::string(truth.first) + " raised " + e.what());
+        }
+    }
+
+    // errors name the key path
+    const std::pair<const char *, const char *> errors[] = {
+        {"{{ missing }}", "\"missing\""},
+        {"{{ user.missing }}", "\"user.missing\""},
+        {"{{ a.b }}", "\"a.b\""},
+        {"{{ toupper(missing) }}", "\"missing\""},
+        {"{% if missing.value %}x{% endif %}", "\"missing.value\""},
+        {"{% if not missing %}x{% endif %}", "\"missing\""},
+        {"{% if a.b %}x{% endif %}", "\"a.b\""},
+        {"{{ a.b + 1 }}", "\"a.b\""},
+        {"{% if user.missing == 1 %}x{% endif %}", "\"user.missing\""},
+    };
+    for(const auto & error: errors)
+    {
+        try
+        {
+            render(error.first);
+            expect(false, std::string(error.first) + " raised");
+        }
+        catch(const ez::temp::renderer::render_exception & e)
+        {
+            expect(std::string(e.what()).find(error.second) != std::string::npos,
+                   std::string(error.first) + ": " + e.what());
+        }
+        catch(const std::exception & e)
+        {
+            expect(false, std::string(error.first) + " raised " + e.what() + ", not a render_exception");
+        }
+    }
+
+    return report();
+}
@@ -0,0 +1,35 @@
+/**
+ * @file eztest.h
+ * Failure counting shared by the test programs.
+ **/
+#ifndef __EZ_TEST_H__
+#define __EZ_TEST_H__
+
+#include <iostream>
+#include <string>
+
+inline int failures = 0;
+
+/**
+ * @brief Count a failure, described by @a what, unless @a condition holds.
+ **/
+inline void expect(bool condition, const std::string & what)
+{
+    if(!condition)
+    {
+        std::cerr << "failed: " << what << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * @brief Print the failure count.
+ * @return The exit status of the test program.
+ **/
+inline int report()
+{
+    std::cout << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
+
+#endif // __EZ_TEST_H__
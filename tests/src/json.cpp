@@ -0,0 +1,64 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * @brief The error raised when parsing @a json, empty if none.
+ **/
+static std::string parse_error(const std::string & json)
+{
+    try
+    {
+        ez::temp::dict::from_json(json);
+        return std::string();
+    }
+    catch(const std::runtime_error & e)
+    {
+        return e.what();
+    }
+}
+
+/**
+ * @brief @a depth nested arrays around a number, as the value of "a".
+ **/
+static std::string nested(int depth, const char * open = "[", const char * close = "]")
+{
+    std::string json = "{ \"a\" : ";
+    for(int ii = 0; ii < depth; ++ii)
+        json += open;
+    json += "1";
+    for(int ii = 0; ii < depth; ++ii)
+        json += close;
+    return json + " }";
+}
+
+/**
+ * Checks that the Json parser rejects numbers with leading zeros and bounds
+ * the nesting depth.
+ **/
+int main()
+{
+    // numbers
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"a\" : [0, -0, 10, 0.5, -0.25e2, 0e1] }");
+    const ez::temp::array & numbers = context["a"].as_array();
+    expect(numbers.size() == 6 && numbers[0].as_int() == 0 && numbers[1].as_int() == 0 && numbers[2].as_int() == 10
+           && numbers[3].as_double() == 0.5 && numbers[4].as_double() == -25 && numbers[5].as_double() == 0, "numbers");
+    for(const char * number: {"01", "-01", "00", "007.5", "00e1"})
+    {
+        const std::string error = parse_error(std::string("{ \"a\" : ") + number + " }");
+        expect(error.find("leading zero") != std::string::npos, std::string(number) + ": " + error);
+    }
+
+    // nesting, the root object included
+    expect(parse_error(nested(511)).empty(), "511 nested arrays: " + parse_error(nested(511)));
+    expect(parse_error(nested(511, "{ \"b\" : ", "}")).empty(), "511 nested objects");
+    expect(parse_error(nested(512)).find("too deeply nested") != std::string::npos, "512 nested arrays");
+    expect(parse_error(nested(100000)).find("too deeply nested") != std::string::npos, "100000 nested arrays");
+    expect(parse_error(nested(100000, "{ \"b\" : ", "}")).find("too deeply nested") != std::string::npos,
+           "100000 nested objects");
+
+    return report();
+}
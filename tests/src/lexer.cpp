@@ -0,0 +1,110 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Describe the compiled tokens of @a input (or the compilation error).
+ **/
+static std::string describe(const std::string & input)
+{
+    std::ostringstream out;
+    try
+    {
+        for(const ez::temp::token & tok: ez::temp::renderer::compile(input))
+        {
+            out << static_cast<int>(tok.op()) << "@" << tok.jump() << ":";
+            switch(tok.token_type())
+            {
+            case ez::temp::token::type::text:
+                out << "[" << tok.text().text() << "]";
+                break;
+            case ez::temp::token::type::render:
+                out << tok.render().function();
+                for(const std::string & key: tok.render().keys())
+                    out << "." << key;
+                break;
+            case ez::temp::token::type::section:
+                for(const std::string & param: tok.section().params())
+                    out << param << " ";
+                break;
+            }
+            out << "\n";
+        }
+    }
+    catch(const std::exception & e)
+    {
+        out << "error: " << e.what();
+    }
+    return out.str();
+}
+
+/**
+ * Lexes edge cases and random templates with every delimiter scanning
+ * implementation supported here and checks they all give the same tokens.
+ **/
+int main(int argc, char ** argv)
+{
+    std::vector<std::string> inputs = {
+        "", "{", "{{", "{%", "}", "}}", "%}", "a{", "a{{", "a{%", "{{}", "{%}", "{{ a }", "{% if a %",
+        "{{ a }}", "{{a}}{{b}}", "{% if a %}x{% endif %}", "{{ a }}{", "{{ a }}}", "{ {{ a }} }",
+        "line\n  {% if a %}\n\tx\n{% endif %}\n", "\n{% if a %}{% endif %}", "  {% if a %}{% endif %}",
+        "{{ toupper(a) }} {{ loop }}", "{%%}", "{{{ a }}}",
+    };
+
+    // a tag at every offset around the vector widths, then truncated everywhere
+    for(int offset = 0; offset < 70; ++offset)
+    {
+        std::string input = std::string(offset, 'x') + "{{ a }}" + std::string(offset % 7, ' ') + "{% if b %}y{% endif %}";
+        inputs.push_back(input);
+        for(std::size_t size = 0; size < input.size(); ++size)
+            inputs.push_back(input.substr(0, size));
+    }
+
+    // random soup of delimiters
+    std::mt19937 random(argc > 1 ? std::atoi(argv[1]) : 42);
+    const std::vector<std::string> pieces = {
+        "{", "}", "%", "{{", "}}", "{%", "%}", " ", "\n", "\t", "a", "b.c", "text ", "{{ a }}",
+        "{% if a %}", "{% else %}", "{% endif %}", "{% for x in l %}", "{% endfor %}", "\xc3\xa9",
+    };
+    for(int ii = 0; ii < 2000; ++ii)
+    {
+        std::string input;
+        int count = random() % 40;
+        for(int jj = 0; jj < count; ++jj)
+            input += pieces[random() % pieces.size()];
+        inputs.push_back(input);
+    }
+
+    std::vector<ez::temp::lexer_isa> isas;
+    for(ez::temp::lexer_isa isa: {ez::temp::lexer_isa::scalar, ez::temp::lexer_isa::sse2, ez::temp::lexer_isa::avx2})
+    {
+        if(ez::temp::renderer::set_lexer_isa(isa))
+            isas.push_back(isa);
+    }
+    std::cout << isas.size() << " lexer implementations" << std::endl;
+
+    int failures = 0;
+    for(const std::string & input: inputs)
+    {
+        ez::temp::renderer::set_lexer_isa(ez::temp::lexer_isa::scalar);
+        const std::string expected = describe(input);
+        for(ez::temp::lexer_isa isa: isas)
+        {
+            ez::temp::renderer::set_lexer_isa(isa);
+            std::string result = describe(input);
+            if(result != expected)
+            {
+                std::cerr << "lexer " << static_cast<int>(isa) << " differs on \"" << input << "\":\n"
+                          << result << "\nexpected:\n" << expected << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    std::cout << inputs.size() << " inputs, " << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <memory_resource>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * @brief Counts the blocks it has outstanding.
+ **/
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    std::size_t outstanding = 0;
+    std::size_t allocations = 0;
+private:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        ++outstanding;
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void * data, std::size_t bytes, std::size_t alignment) override
+    {
+        --outstanding;
+        std::pmr::new_delete_resource()->deallocate(data, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/**
+ * Checks that the context types allocate from the memory_scope of the
+ * thread, and free to the resource they come from.
+ **/
+int main()
+{
+    counting_resource resource;
+    const std::string json = "{ \"title\" : \"a title longer than a node holds inline\", "
+                             "\"items\" : [1, 2, 3], \"user\" : { \"name\" : \"me\" } }";
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(
+        "{{ title }}:{% for item in items %} {{ item }}/{{ loop.length }}{% endfor %} {{ user.name }}");
+    const std::string expected = ez::temp::renderer::render(tmpl, ez::temp::dict::from_json(json));
+
+    expect(ez::temp::memory_scope::current() == nullptr, "no scope by default");
+    ez::temp::node copy;
+    {
+        ez::temp::dict context = ez::temp::dict::from_json(json, &resource);
+        expect(ez::temp::memory_scope::current() == nullptr, "scope restored");
+        expect(resource.allocations > 0 && resource.outstanding > 0, "context allocated from the resource");
+
+        // copies made out of a scope use the global operator new, and free wherever
+        const std::size_t before = resource.allocations;
+        copy = context["title"];
+        expect(resource.allocations == before, "copy out of the scope");
+
+        // nested scopes
+        counting_resource inner;
+        {
+            ez::temp::memory_scope outer_scope(&resource);
+            {
+                ez::temp::memory_scope inner_scope(&inner);
+                context["inner"] = ez::temp::array{ez::temp::node(1)};
+            }
+            expect(ez::temp::memory_scope::current() == &resource, "nested scope restored");
+        }
+        expect(inner.outstanding == 2, "nested scope allocations: the entry and the array");
+        context.erase("inner");
+        expect(inner.outstanding == 0, "freed to the nested resource");
+
+        // render with the loop scopes on the resource
+        std::pmr::string output(&resource);
+        ez::temp::pmr_string_sink sink(output);
+        ez::temp::render_options options;
+        options.memory = &resource;
+        const std::size_t rendering = resource.allocations;
+        ez::temp::renderer::render(tmpl, context, sink, options);
+        expect(std::string(output) == expected, "rendered: " + std::string(output));
+        expect(resource.allocations > rendering, "loop scope allocated from the resource");
+
+        // every chunk of a parallel loop allocates from it, whichever thread renders it
+        ez::temp::renderer::add_function("scoped", [](const ez::temp::array &) -> std::string {
+            return ez::temp::memory_scope::current() ? "+" : "-";
+        });
+        ez::temp::array rows;
+        for(int ii = 0; ii < 64; ++ii)
+            rows.emplace_back(ez::temp::node("a row longer than a node holds inline"));
+        context["rows"] = std::move(rows);
+        const ez::temp::compiled_template parallel = ez::temp::renderer::compile(
+            "{% for row in rows parallel %}{{ toupper(row) }}{{ loop.index }}{{ scoped() }}{% endfor %}");
+        options.parallel = true;
+        options.threads = 4;
+        options.min_chunk = 4;
+        std::string parallel_expected;
+        for(int ii = 1; ii <= 64; ++ii)
+            parallel_expected += "A ROW LONGER THAN A NODE HOLDS INLINE" + std::to_string(ii) + "+";
+        output.clear();
+        const std::size_t parallel_rendering = resource.allocations;
+        ez::temp::renderer::render(parallel, context, sink, options);
+        expect(std::string(output) == parallel_expected, "rendered in parallel: " + std::string(output));
+        expect(resource.allocations > parallel_rendering, "parallel loop allocated from the resource");
+        context.erase("rows");
+    }
+    expect(resource.outstanding == 0, "everything freed to the resource");
+    expect(copy.as_string() == "a title longer than a node holds inline", "copy outlives the context");
+
+    // a whole request on a monotonic arena
+    char buffer[16 * 1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    {
+        std::pmr::string output(&arena);
+        ez::temp::dict context = ez::temp::dict::from_json(json, &arena);
+        ez::temp::render_options options;
+        options.memory = &arena;
+        ez::temp::pmr_string_sink sink(output);
+        ez::temp::renderer::render(tmpl, context, sink, options);
+        expect(std::string(output) == expected, "rendered on the arena");
+    }
+
+    return report();
+}
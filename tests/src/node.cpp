@@ -0,0 +1,37 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * Checks that a node can be assigned a value it holds.
+ **/
+int main()
+{
+    const std::string text = "a string longer than a node holds inline";
+
+    // moved from an array item
+    {
+        ez::temp::node n = ez::temp::array{ez::temp::node(text), ez::temp::node(2)};
+        n = std::move(n.as_array()[0]);
+        expect(n.is_string() && n.as_string() == text, "moved array item");
+    }
+
+    // moved from an object member, itself an array
+    {
+        ez::temp::node n = ez::temp::object{{"items", ez::temp::array{ez::temp::node(1), ez::temp::node(text)}}};
+        n = std::move(n.as_object()["items"]);
+        expect(n.is_array() && n.as_array().size() == 2 && n.as_array()[1].as_string() == text, "moved object member");
+    }
+
+    // copied from an array item
+    {
+        ez::temp::node n = ez::temp::array{ez::temp::node(ez::temp::object{{"name", text}})};
+        n = n.as_array()[0];
+        expect(n.is_object() && n.as_object().at("name").as_string() == text, "copied array item");
+    }
+
+    return report();
+}
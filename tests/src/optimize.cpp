@@ -0,0 +1,61 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * @brief Check that @a input renders the same optimized or not, with @a tokens tokens once optimized.
+ **/
+static void check(const std::string & input, const ez::temp::dict & context, std::size_t tokens)
+{
+    ez::temp::compiled_template plain = ez::temp::renderer::compile(input, "", false);
+    ez::temp::compiled_template optimized = ez::temp::renderer::compile(input);
+    expect(ez::temp::renderer::render(plain, context) == ez::temp::renderer::render(optimized, context), "same output: " + input);
+    expect(optimized.size() == tokens, "token count: " + input + " (" + std::to_string(optimized.size()) + ")");
+    expect(plain.size() - optimized.size() == optimized.removed_tokens(), "removed count: " + input);
+}
+
+/**
+ * Checks that the optimization pass keeps the output and removes the
+ * expected tokens.
+ **/
+int main()
+{
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"name\" : \"world\", \"items\" : [1, 2, 3], \"on\" : true }");
+
+    // texts merged across constants and folded ifs
+    check("Hello {{ 6 * 7 }} {{ 'x' + 1 }}!", context, 1);
+    check("a{% if 1 > 2 %}b{% else %}c{% endif %}d{% if 2 > 1 %}e{% endif %}f", context, 1);
+    check("{% if 'a' != 'b' and 1 %}{% if 0 %}no{% else %}yes{% endif %}{% endif %}", context, 1);
+
+    // context dependent tokens kept, nested bodies still merged
+    check("<ul>{% for i in items %}<li>{{ i }}{{ '-' }}</li>{% if on %}!{% endif %}{% endfor %}</ul>", context, 10);
+    check("{% block b %}Hello {{ name }}{% endblock %}{% unknown %}", context, 2);
+
+    // errors of constant expressions are left to render time
+    ez::temp::compiled_template failing = ez::temp::renderer::compile("a{% if 'a' < 1 %}b{% endif %}");
+    expect(failing.size() == 4 && failing.removed_tokens() == 0, "failing condition kept");
+    try
+    {
+        ez::temp::renderer::render(failing, context);
+        expect(false, "failing condition raised");
+    }
+    catch(const ez::temp::renderer::render_exception &)
+    {
+    }
+
+    // optimizing again removes nothing
+    ez::temp::compiled_template twice = ez::temp::renderer::compile("a{{ 1 }}b{% if on %}c{% endif %}");
+    expect(twice.optimize() == 0 && twice.removed_tokens() == 2, "idempotent");
+
+    // layouts leave block markers and fragments around the replaced blocks
+    ez::temp::compiled_template page = ez::temp::renderer::compile_file("templates/index.html.ez", false);
+    ez::temp::dict page_context = ez::temp::dict::from_json("{ \"who\" : \"w\", \"list\" : [\"a\", \"b\", \"c\"] }");
+    std::string expected = ez::temp::renderer::render(page, page_context);
+    std::size_t removed = page.optimize();
+    expect(removed > 0 && ez::temp::renderer::render(page, page_context) == expected, "layout optimized");
+
+    return report();
+}
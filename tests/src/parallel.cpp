@@ -0,0 +1,81 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Render @a tmpl with @a options, or the exception message.
+ **/
+static std::string render(const ez::temp::compiled_template & tmpl, const ez::temp::dict & context,
+                          const ez::temp::render_options & options)
+{
+    std::string output;
+    ez::temp::string_sink sink(output);
+    try
+    {
+        ez::temp::renderer::render(tmpl, context, sink, options);
+    }
+    catch(const std::exception & e)
+    {
+        output = std::string("error: ") + e.what();
+    }
+    return output;
+}
+
+/**
+ * Renders loops split into chunks with several thread counts and chunk
+ * sizes and checks the output against the sequential rendering.
+ **/
+int main()
+{
+    const std::vector<std::string> inputs = {
+        "{% for row in rows %}{{ loop.index }}/{{ loop.length }}:{{ row.id }}"
+        "{% if loop.first %} first{% endif %}{% if loop.last %} last{% endif %}"
+        " {{ loop.revindex0 }}\n{% endfor %}",
+        "{% for row in rows parallel %}[{% for cell in row.cells %}{{ loop.parent.index0 }}.{{ loop.index0 }}={{ cell }}"
+        "{% if not loop.last %},{% endif %}{% endfor %}]{% endfor %}",
+        "{% for row in rows %}{% if row.id > 500 and row.id < 510 %}{{ row.id * 2 }};{% endif %}{% endfor %}",
+        "{% for row in rows %}{% if row.id == 700 %}{{ row.missing }}{% endif %}{% endfor %}",
+    };
+
+    ez::temp::array rows;
+    for(int ii = 0; ii < 1000; ++ii)
+    {
+        ez::temp::object row;
+        row["id"] = ii;
+        row["cells"] = ez::temp::array(ii % 4, ez::temp::node(ii));
+        rows.push_back(std::move(row));
+    }
+    ez::temp::dict context;
+    context["rows"] = std::move(rows);
+
+    int renders = 0;
+    int failures = 0;
+    for(const std::string & input: inputs)
+    {
+        const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(input);
+        const std::string expected = render(tmpl, context, ez::temp::render_options());
+        for(unsigned threads: {1u, 2u, 3u, 8u})
+        {
+            for(std::size_t min_chunk: {1u, 7u, 256u, 1000u})
+            {
+                ez::temp::render_options options;
+                options.parallel = true;
+                options.threads = threads;
+                options.min_chunk = min_chunk;
+                std::string result = render(tmpl, context, options);
+                ++renders;
+                if(result != expected)
+                {
+                    std::cerr << "\"" << input << "\" differs with " << threads << " threads and chunks of "
+                              << min_chunk << ":\n" << result << "\nexpected:\n" << expected << std::endl;
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    std::cout << renders << " renders, " << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "eztest.h"
+
+/**
+ * Checks the counters, locations and reports of render_profile.
+ **/
+int main()
+{
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(
+        "<ul>\n"
+        "{% for item in items %}\n"
+        "<li>{{ item }}{% if loop.last %}.{% else %},{% endif %}</li>\n"
+        "{% endfor %}\n"
+        "</ul>\n");
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"items\" : [\"a\", \"b\", \"c\"] }");
+
+    ez::temp::render_profile profile(tmpl);
+    ez::temp::render_options options;
+    options.profile = &profile;
+    options.parallel = true;    // ignored while profiling
+    std::string output;
+    ez::temp::string_sink sink(output);
+    ez::temp::renderer::render(tmpl, context, sink, options);
+    expect(output == ez::temp::renderer::render(tmpl, context), "same output");
+
+    // the tokens: <ul>, for, <li>, item, if, ., else, ",", endif, </li>, endfor, </ul>
+    const std::vector<ez::temp::render_profile::location> locations = profile.locate();
+    int for_loop = -1;
+    int item = -1;
+    int if_test = -1;
+    for(int index = 0; index < static_cast<int>(tmpl.size()); ++index)
+    {
+        if(tmpl[index].op() == ez::temp::opcode::for_loop)
+            for_loop = index;
+        else if(tmpl[index].op() == ez::temp::opcode::render)
+            item = index;
+        else if(tmpl[index].op() == ez::temp::opcode::if_test)
+            if_test = index;
+    }
+    expect(for_loop >= 0 && item >= 0 && if_test >= 0, "tokens found");
+    expect(locations[for_loop].line == 2 && locations[item].line == 3 && locations[if_test].line == 3, "lines");
+
+    expect(profile.tokens()[for_loop].calls == 1 && profile.tokens()[item].calls == 3 && profile.tokens()[if_test].calls == 3, "calls");
+    expect(profile.tokens()[item].bytes == 3, "item bytes");
+    expect(profile.total(for_loop).bytes == output.size() - std::string("<ul>\n</ul>\n").size(), "loop bytes");
+    expect(profile.total(if_test).bytes == 3 && profile.self(if_test).bytes == 0, "if bytes");
+    expect(profile.self(for_loop).nanoseconds <= profile.total(for_loop).nanoseconds, "self within total");
+
+    // reports
+    std::stringstream table;
+    profile.write_table(table);
+    expect(table.str().find("line 2") != std::string::npos && table.str().find("{% for item in items %}") != std::string::npos, "table");
+    std::stringstream folded;
+    profile.write_folded(folded);
+    expect(folded.str().find("line 2 {% for item in items %};line 3 {{ item }} ") != std::string::npos, "folded stacks");
+
+    // accumulated over renders, cleared
+    ez::temp::renderer::render(tmpl, context, sink, options);
+    expect(profile.tokens()[item].calls == 6, "accumulated");
+    profile.clear();
+    expect(profile.tokens()[item].calls == 0, "cleared");
+
+    // bound to its template
+    const ez::temp::compiled_template other = ez::temp::renderer::compile("x");
+    try
+    {
+        ez::temp::renderer::render(other, context, sink, options);
+        expect(false, "other template rejected");
+    }
+    catch(const ez::temp::renderer::render_exception &)
+    {
+    }
+
+    return report();
+}
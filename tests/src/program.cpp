@@ -0,0 +1,85 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "eztest.h"
+
+/**
+ * @brief Whether compiling @a input fails with a compile_exception.
+ **/
+static bool compile_fails(const std::string & input)
+{
+    try
+    {
+        ez::temp::renderer::compile(input);
+        return false;
+    }
+    catch(const ez::temp::renderer::compile_exception &)
+    {
+        return true;
+    }
+}
+
+/**
+ * Checks the tokens of a compiled template: their opcodes, payloads and
+ * positions, and the jumps linking nested sections.
+ **/
+int main()
+{
+    using ez::temp::opcode;
+
+    const std::string input =
+        "a{% for i in xs %}{% if i %}b{% else %}{% for j in ys %}{{ j }}{% endfor %}{% endif %}{% endfor %}{{ toupper(name) }}";
+    const ez::temp::compiled_template prog = ez::temp::renderer::compile(input, "", false);
+
+    const std::vector<opcode> ops = {
+        opcode::text, opcode::for_loop, opcode::if_test, opcode::text, opcode::else_branch, opcode::for_loop,
+        opcode::render, opcode::endfor, opcode::endif, opcode::endfor, opcode::render,
+    };
+    expect(prog.size() == ops.size(), "token count: " + std::to_string(prog.size()));
+    for(std::size_t ii = 0; ii < prog.size() && ii < ops.size(); ++ii)
+        expect(prog[ii].op() == ops[ii], "opcode " + std::to_string(ii));
+    if(prog.size() != ops.size())
+        return report();
+
+    // open sections jump to their else or end, ends jump back to their open section
+    const std::vector<int> jumps = {-1, 9, 4, -1, 8, 7, -1, 5, 2, 1, -1};
+    for(std::size_t ii = 0; ii < prog.size(); ++ii)
+        expect(prog[ii].jump() == jumps[ii], "jump " + std::to_string(ii) + ": " + std::to_string(prog[ii].jump()));
+
+    // payloads
+    expect(prog[0].token_type() == ez::temp::token::type::text && prog[0].text().text() == "a", "text token");
+    expect(prog[1].token_type() == ez::temp::token::type::section, "section token");
+    expect(prog[1].section().loop_keys() == std::vector<std::string>({"xs"}) && !prog[1].section().is_parallel(), "loop keys");
+    expect(prog[2].section().condition().source() == "i", "condition");
+    expect(prog[6].token_type() == ez::temp::token::type::render && prog[6].render().keys() == std::vector<std::string>({"j"}),
+           "render keys");
+    expect(prog[10].render().is_function() && prog[10].render().function() == "toupper"
+           && prog[10].render().arguments() == std::vector<std::vector<std::string>>({{"name"}}), "render function");
+
+    // positions in the source
+    const std::string_view source = prog.sources().at(0)->text();
+    expect(prog[0].position() == source.data(), "text position");
+    expect(prog[5].position() == source.data() + input.find("{% for j"), "section position");
+    expect(prog[10].position() == source.data() + input.find("{{ toupper"), "render position");
+
+    // the jumps of an if without else, and of a cache section
+    const ez::temp::compiled_template other = ez::temp::renderer::compile("{% if a %}{% cache 'k' %}x{% endcache %}{% endif %}", "", false);
+    expect(other.size() == 5 && other[0].jump() == 4 && other[1].jump() == 3 && other[3].jump() == 1 && other[4].jump() == 0,
+           "if and cache jumps");
+
+    // the jumps are kept by optimize()
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"xs\" : [1, 0], \"ys\" : [\"y\", \"z\"], \"name\" : \"n\" }");
+    ez::temp::compiled_template optimized = ez::temp::renderer::compile(input, "", false);
+    optimized.optimize();
+    expect(ez::temp::renderer::render(optimized, context) == "abyzN", "optimized output");
+    expect(ez::temp::renderer::render(prog, context) == "abyzN", "output");
+
+    for(const char * invalid: {"{% endfor %}", "{% if a %}{% endfor %}{% endif %}", "{% for i in xs %}{% else %}{% endfor %}",
+                                      "{% if a %}{% else %}{% else %}{% endif %}", "{% cache 'k' %}"})
+        expect(compile_fails(invalid), std::string("unbalanced: ") + invalid);
+
+    return report();
+}
@@ -0,0 +1,161 @@
+#include <eztemp.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <boost/algorithm/string/join.hpp>
+
+#include "eztest.h"
+
+/**
+ * @brief Yields "item 1" .. "item n".
+ **/
+class counter_sequence: public ez::temp::sequence
+{
+public:
+    counter_sequence(std::size_t count): m_count(count) {}
+    std::size_t size() override { return m_count; }
+    bool next(ez::temp::node & item) override
+    {
+        if(m_index == m_count)
+            return false;
+        item = "item " + std::to_string(++m_index);
+        return true;
+    }
+private:
+    std::size_t m_count;
+    std::size_t m_index = 0;
+};
+
+/**
+ * @brief Counts the calls for each key path.
+ **/
+class counting_provider: public ez::temp::context_provider
+{
+public:
+    bool resolve(const std::vector<std::string> & keys, ez::temp::node & value) override
+    {
+        const std::string path = boost::algorithm::join(keys, ".");
+        ++resolved[path];
+        if(path == "user")
+            value = ez::temp::object{{"name", "bob"}, {"admin", true}};
+        else if(path == "price")
+            value = 21;
+        else if(path == "rows")
+        {
+            ez::temp::array rows;
+            for(int ii = 0; ii < 1000; ++ii)
+                rows.emplace_back(ii);
+            value = std::move(rows);
+        }
+        else
+            return false;
+        return true;
+    }
+
+    std::unique_ptr<ez::temp::sequence> iterate(const std::vector<std::string> & keys) override
+    {
+        const std::string path = boost::algorithm::join(keys, ".");
+        ++iterated[path];
+        if(path == "items")
+            return std::make_unique<counter_sequence>(3);
+        return nullptr;
+    }
+
+    std::map<std::string, int> resolved;
+    std::map<std::string, int> iterated;
+};
+
+static std::string render(const std::string & input, const ez::temp::dict & context, counting_provider & provider,
+                          ez::temp::render_options options = ez::temp::render_options())
+{
+    std::string output;
+    ez::temp::string_sink sink(output);
+    options.provider = &provider;
+    ez::temp::renderer::render(ez::temp::renderer::compile(input), context, sink, options);
+    return output;
+}
+
+/**
+ * Checks that a context_provider is asked for the values a render uses, once.
+ **/
+int main()
+{
+    {
+        counting_provider provider;
+        const std::string output = render(
+            "{{ user.name }} {{ user.name }}{% if user.admin %}!{% endif %} {{ price * 2 }} "
+            "{% for i in items %}{{ loop.index }}/{{ loop.length }}={{ i }}{% if loop.last %}.{% endif %}{% endfor %} "
+            "{% for i in items %}{{ i }};{% endfor %}{% if not user.admin %}{{ expensive }}{% endif %}",
+            ez::temp::dict(), provider);
+        expect(output == "bob bob! 42 1/3=item 12/3=item 23/3=item 3. item 1;item 2;item 3;", "output: " + output);
+        expect(provider.resolved["user.name"] == 1 && provider.resolved["user"] == 1, "memoized prefix");
+        expect(provider.resolved["user.admin"] == 1, "memoized path");
+        expect(provider.resolved["price"] == 1, "value");
+        expect(provider.iterated["items"] == 2 && !provider.resolved.count("items"), "sequences per loop");
+        expect(!provider.resolved.count("expensive"), "untaken branch not asked");
+    }
+
+    // the dict comes first
+    {
+        counting_provider provider;
+        ez::temp::dict context;
+        context["price"] = 5;
+        expect(render("{{ price }}{{ user.name }}", context, provider) == "5bob", "dict and provider");
+        expect(!provider.resolved.count("price"), "dict key not asked");
+    }
+
+    // missing values
+    {
+        counting_provider provider;
+        try
+        {
+            render("{{ missing }}", ez::temp::dict(), provider);
+            expect(false, "missing raised");
+        }
+        catch(const std::exception &)
+        {
+        }
+        expect(provider.resolved["missing"] == 1, "missing asked");
+    }
+
+    // a path going through a provided scalar
+    for(const char * input: {"{{ price.amount }}", "{% if price.amount > 1 %}x{% endif %}", "{{ user.name.first }}"})
+    {
+        counting_provider provider;
+        try
+        {
+            render(input, ez::temp::dict(), provider);
+            expect(false, std::string(input) + " raised");
+        }
+        catch(const ez::temp::renderer::render_exception & e)
+        {
+            expect(std::string(e.what()).find("is int, not object") != std::string::npos
+                   || std::string(e.what()).find("is string, not object") != std::string::npos,
+                   std::string(input) + ": " + e.what());
+        }
+        catch(const std::exception & e)
+        {
+            expect(false, std::string(input) + " raised " + e.what() + ", not a render_exception");
+        }
+    }
+
+    // arrays resolved for parallel loops, values shared by the chunks
+    {
+        counting_provider provider;
+        ez::temp::render_options options;
+        options.parallel = true;
+        options.threads = 4;
+        options.min_chunk = 16;
+        std::string expected;
+        for(int ii = 0; ii < 1000; ++ii)
+            expected += std::to_string(ii) + "bob;";
+        expect(render("{% for r in rows %}{{ r }}{{ user.name }};{% endfor %}", ez::temp::dict(), provider, options) == expected,
+               "parallel loop");
+        expect(provider.iterated["rows"] == 1 && provider.resolved["rows"] == 1, "rows asked once");
+        expect(provider.resolved["user.name"] == 1 && provider.resolved["user"] == 1, "parallel memoized");
+    }
+
+    return report();
+}
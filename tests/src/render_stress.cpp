@@ -0,0 +1,82 @@
+#include <eztemp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * Renders the same compiled template from an increasing number of threads,
+ * checks every output against a single threaded reference and reports the
+ * throughput scaling.
+ **/
+int main(int argc, char ** argv)
+{
+    int renders = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    ez::temp::renderer::add_function("twice", [](const ez::temp::array & args) -> std::string {
+        std::string str(args.at(0).as_string());
+        return str + str;
+    });
+    ez::temp::renderer::freeze_functions();
+
+    const std::string input =
+        "{% for row in rows %}"
+        "{{ loop.index }}: {{ row }} {{ twice(row) }} {{ toupper(title) }}"
+        "{% if loop.last %} (last){% else %},{% endif %}\n"
+        "{% endfor %}";
+
+    ez::temp::array rows;
+    for(int ii = 0; ii < 200; ++ii)
+    {
+        rows.push_back(std::string("row") + std::to_string(ii));
+    }
+    ez::temp::dict context;
+    context["title"] = std::string("stress");
+    context["rows"] = rows;
+
+    const ez::temp::compiled_template tmpl = ez::temp::renderer::compile(input);
+    const std::string reference = ez::temp::renderer::render(tmpl, context);
+
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    std::atomic<int> mismatches(0);
+    double single_rate = 0.;
+
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for(unsigned tt = 0; tt < threads; ++tt)
+        {
+            workers.emplace_back([&, tt]() {
+                // concurrent compilation resolves functions from the frozen registry
+                const ez::temp::compiled_template local = ez::temp::renderer::compile(input);
+                for(int ii = 0; ii < renders; ++ii)
+                {
+                    const ez::temp::compiled_template & used = (ii % 2) ? local : tmpl;
+                    if(ez::temp::renderer::render(used, context) != reference)
+                        ++mismatches;
+                }
+            });
+        }
+        for(std::thread & worker: workers)
+        {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = threads * renders / seconds;
+        if(threads == 1)
+            single_rate = rate;
+        std::cout << threads << " thread(s): " << rate << " renders/s, speedup x" << rate / single_rate << std::endl;
+    }
+
+    if(mismatches)
+    {
+        std::cerr << mismatches << " mismatching renders" << std::endl;
+        return 1;
+    }
+    return 0;
+}
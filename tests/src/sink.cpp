@@ -0,0 +1,78 @@
+#include <eztemp.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "eztest.h"
+
+/**
+ * @brief The bytes written to @a file so far.
+ **/
+static std::string contents(std::FILE * file)
+{
+    std::fflush(file);
+    std::rewind(file);
+    std::string result;
+    char buffer[4096];
+    for(std::size_t size; (size = std::fread(buffer, 1, sizeof(buffer), file)) > 0; )
+        result.append(buffer, size);
+    std::fseek(file, 0, SEEK_END);
+    return result;
+}
+
+/**
+ * Checks that rendering through a callback_sink or an fd_sink writes the
+ * same bytes as a string_sink.
+ **/
+int main()
+{
+    const ez::temp::compiled_template prog = ez::temp::renderer::compile(
+        "Hello {{ name }}: {% for i in items %}{{ i }},{% endfor %} {{ toupper(name) }}\n");
+    ez::temp::dict context = ez::temp::dict::from_json("{ \"name\" : \"bob\", \"items\" : [1, 2, 3] }");
+    const std::string expected = ez::temp::renderer::render(prog, context);
+    expect(expected == "Hello bob: 1,2,3, BOB\n", "string output: " + expected);
+
+    // callback_sink: the pieces, in order
+    {
+        std::vector<std::string> chunks;
+        ez::temp::callback_sink sink([&chunks](const char * data, std::size_t size) {
+            chunks.emplace_back(data, size);
+        });
+        ez::temp::renderer::render(prog, context, sink);
+        std::string joined;
+        for(const std::string & chunk: chunks)
+            joined += chunk;
+        expect(joined == expected, "callback output: " + joined);
+        expect(chunks.size() > 1, "callback pieces");
+    }
+
+    // fd_sink: flushed at the end of the render
+    {
+        std::FILE * file = std::tmpfile();
+        ez::temp::fd_sink sink(fileno(file));
+        ez::temp::renderer::render(prog, context, sink);
+        expect(contents(file) == expected, "fd output");
+        std::fclose(file);
+    }
+
+    // fd_sink: flushed past the threshold, then on destruction
+    {
+        std::FILE * file = std::tmpfile();
+        {
+            ez::temp::fd_sink sink(fileno(file), 8);
+            ez::temp::output_sink & output = sink;
+            output.write("12345");
+            expect(contents(file).empty(), "buffered");
+            output.write("6789");
+            expect(contents(file) == "123456789", "threshold flush");
+            output.write("abc");
+            expect(contents(file) == "123456789", "buffered again");
+        }
+        expect(contents(file) == "123456789abc", "flush on destruction");
+        std::fclose(file);
+    }
+
+    return report();
+}